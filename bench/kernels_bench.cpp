@@ -0,0 +1,432 @@
+// Microbenchmarks for the SDL-free fractal kernels in fractals/kernels.h.
+//
+// Every benchmark runs a fixed input a few times to warm up, then times a
+// number of repetitions. Results go to stdout as JSON (one object per
+// kernel with min/median/mean/stddev and throughput) and to stderr as a
+// table. The checksum of each kernel's output is included so a change in
+// results shows up next to a change in speed.
+//
+// usage: fractal_bench [--reps N] [--warmup N] [--filter SUBSTR]
+
+#include "kernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifndef FRACTAL_VERSION
+#define FRACTAL_VERSION "dev"
+#endif
+
+namespace {
+
+struct Options {
+  int reps = 20;
+  int warmup = 3;
+  const char *filter = nullptr;
+};
+
+struct Result {
+  std::string name;
+  size_t items;
+  double minNs, medianNs, meanNs, stddevNs;
+  uint64_t checksum;
+};
+
+// Folds the bit pattern of v into an FNV-style running hash.
+uint64_t mix(uint64_t h, float v) {
+  uint32_t bits;
+  std::memcpy(&bits, &v, sizeof(bits));
+  return (h ^ bits) * 0x100000001b3ull;
+}
+
+// A benchmark body runs the kernel once on its fixed input, from a state
+// set up outside the timed region, and returns a checksum of the output.
+struct Bench {
+  const char *name;
+  size_t items;
+  std::function<void()> setup;
+  std::function<uint64_t()> run;
+};
+
+Result measure(const Bench &b, const Options &opt) {
+  uint64_t checksum = 0;
+  for (int i = 0; i < opt.warmup; ++i) {
+    b.setup();
+    checksum = b.run();
+  }
+
+  std::vector<double> ns;
+  for (int i = 0; i < opt.reps; ++i) {
+    b.setup();
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t c = b.run();
+    auto t1 = std::chrono::steady_clock::now();
+    ns.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+    if (c != checksum) {
+      fprintf(stderr, "%s: output changed between repetitions\n", b.name);
+      std::exit(1);
+    }
+  }
+
+  std::sort(ns.begin(), ns.end());
+  double sum = 0.0, sq = 0.0;
+  for (double v : ns)
+    sum += v;
+  double mean = sum / ns.size();
+  for (double v : ns)
+    sq += (v - mean) * (v - mean);
+
+  size_t m = ns.size() / 2;
+  double median = ns.size() % 2 ? ns[m] : (ns[m - 1] + ns[m]) * 0.5;
+  return {b.name, b.items, ns.front(), median, mean,
+          std::sqrt(sq / ns.size()), checksum};
+}
+
+// --- fixed inputs ---
+
+constexpr int escW = 512, escH = 256, escIter = 256;
+
+struct EscapeState {
+  std::vector<double> zx, zy, cx;
+  std::vector<int> iters;
+  std::vector<float> smooth;
+
+  void reset() {
+    size_t n = (size_t)escW * escH;
+    zx.assign(n, 0.0);
+    zy.assign(n, 0.0);
+    iters.assign(n, 0);
+    smooth.assign(n, -1.0f);
+    cx.resize(escW);
+    for (int x = 0; x < escW; ++x)
+      cx[x] = (x - escW / 2) * 4.0 / escW - 0.5;
+  }
+
+  double rowY(int y) const { return (y - escH / 2) * 4.0 / escW; }
+
+  uint64_t checksum() const {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < iters.size(); ++i)
+      h = mix(h, iters[i] + smooth[i]);
+    return h;
+  }
+};
+
+EscapeState esc;
+
+// Every row of the escape input, escIter passes, with formula F.
+template <class F> uint64_t escapeRows() {
+  for (int n = 1; n <= escIter; ++n)
+    for (int y = 0; y < escH; ++y) {
+      size_t i = (size_t)y * escW;
+      int first = escW, last = 0;
+      escapeStepRow<F>(&esc.zx[i], &esc.zy[i], &esc.iters[i], &esc.smooth[i],
+                       escW, esc.cx.data(), esc.rowY(y), n, escIter, first,
+                       last);
+    }
+  return esc.checksum();
+}
+
+std::vector<Segment2f> kochIn, kochOut;
+std::vector<float> plasmaGrid;
+std::vector<float> treeEx, treeEy, treeUx, treeUy;
+
+constexpr int kochLevel = 6;
+constexpr int hilbertN = 1024;
+constexpr int plasmaSize = 513;
+constexpr int mengerSize = 729;
+constexpr int sierpinskiLevel = 9;
+constexpr int treeDepth = 20;
+constexpr int flameSteps = 1 << 16;
+constexpr int juliaW = 1920, juliaH = 1080, juliaIter = 128;
+constexpr int lineW = 1920, lineH = 1080, lineCount = 1 << 18;
+
+std::vector<Bench> benches() {
+  std::vector<Bench> list;
+
+  list.push_back({"escape_step_rows", (size_t)escW * escH * escIter,
+                  [] { esc.reset(); }, escapeRows<QuadraticFormula>});
+  list.push_back({"escape_step_rows_burning_ship",
+                  (size_t)escW * escH * escIter, [] { esc.reset(); },
+                  escapeRows<BurningShipFormula>});
+  list.push_back({"escape_step_rows_tricorn", (size_t)escW * escH * escIter,
+                  [] { esc.reset(); }, escapeRows<TricornFormula>});
+  list.push_back({"escape_step_rows_multibrot3",
+                  (size_t)escW * escH * escIter, [] { esc.reset(); },
+                  escapeRows<MultibrotFormula<3>>});
+
+  // One 1920 x 1080 frame of the realtime Julia kernel, single-threaded.
+  list.push_back({"julia_row_float", (size_t)juliaW * juliaH, [] {}, [] {
+                    std::vector<float> row(juliaW);
+                    uint64_t h = 0xcbf29ce484222325ull;
+                    float scale = 4.0f / juliaW;
+                    for (int y = 0; y < juliaH; ++y) {
+                      juliaRowFloat(row.data(), juliaW, -2.0f, scale,
+                                    (y - juliaH / 2) * scale, -0.7f, 0.27015f,
+                                    juliaIter);
+                      h = mix(h, row[y % juliaW]);
+                    }
+                    return h;
+                  }});
+
+  // Short anti-aliased segments scattered over a 1920 x 1080 canvas, the
+  // shape of a deep tree level, drawn single-threaded without tiling.
+  list.push_back({"wu_line", (size_t)lineCount, [] {}, [] {
+                    static std::vector<uint32_t> canvas;
+                    canvas.assign((size_t)lineW * lineH, 0x000000FFu);
+                    uint32_t s = 12345;
+                    auto next = [&s] {
+                      s = s * 1664525u + 1013904223u;
+                      return (s >> 8) * (1.0f / 16777216.0f);
+                    };
+                    for (int i = 0; i < lineCount; ++i) {
+                      float x = next() * lineW, y = next() * lineH;
+                      float a = next() * 6.2831853f, len = 2.0f + next() * 30;
+                      wuLine(canvas.data(), lineW, x, y, x + len * std::cos(a),
+                             y + len * std::sin(a), 0xFFC080FFu, 0, 0, lineW,
+                             lineH);
+                    }
+                    uint64_t h = 0xcbf29ce484222325ull;
+                    for (size_t i = 0; i < canvas.size(); i += 997)
+                      h = (h ^ canvas[i]) * 0x100000001b3ull;
+                    return h;
+                  }});
+
+  list.push_back({"escape_smooth_orbit", (size_t)escW * escH, [] {},
+                  [] {
+                    uint64_t h = 0xcbf29ce484222325ull;
+                    for (int y = 0; y < escH; ++y)
+                      for (int x = 0; x < escW; ++x) {
+                        int n;
+                        double cx = (x - escW / 2) * 4.0 / escW - 0.5;
+                        double cy = (y - escH / 2) * 4.0 / escW;
+                        h = mix(h, escapeSmooth<QuadraticFormula>(
+                                       0, 0, cx, cy, escIter, n));
+                      }
+                    return h;
+                  }});
+
+  // Koch level kochLevel -> kochLevel + 1 from the base triangle.
+  size_t kochN = 3;
+  for (int i = 0; i < kochLevel; ++i)
+    kochN *= 4;
+  list.push_back({"koch_subdivide", kochN,
+                  [] {
+                    if (!kochIn.empty())
+                      return;
+                    std::vector<Segment2f> cur = {{{640, 100}, {900, 550}},
+                                                  {{900, 550}, {380, 550}},
+                                                  {{380, 550}, {640, 100}}};
+                    for (int i = 0; i < kochLevel; ++i) {
+                      std::vector<Segment2f> nxt(cur.size() * 4);
+                      kochSubdivide(cur.data(), cur.size(), nxt.data());
+                      cur.swap(nxt);
+                    }
+                    kochIn = cur;
+                    kochOut.resize(kochIn.size() * 4);
+                  },
+                  [] {
+                    kochSubdivide(kochIn.data(), kochIn.size(),
+                                  kochOut.data());
+                    uint64_t h = 0xcbf29ce484222325ull;
+                    for (size_t i = 0; i < kochOut.size(); i += 97)
+                      h = mix(mix(h, kochOut[i].a.x), kochOut[i].b.y);
+                    return h;
+                  }});
+
+  list.push_back({"hilbert_d2xy", (size_t)hilbertN * hilbertN, [] {}, [] {
+                    uint64_t h = 0xcbf29ce484222325ull;
+                    float sx = 0.0f, sy = 0.0f;
+                    for (int d = 0; d < hilbertN * hilbertN; ++d) {
+                      Point2f p = hilbertD2xy(hilbertN, d);
+                      sx += p.x;
+                      sy += p.y;
+                    }
+                    return mix(mix(h, sx), sy);
+                  }});
+
+  list.push_back(
+      {"plasma_midpoint", (size_t)(plasmaSize - 1) * (plasmaSize - 1),
+       [] {
+         plasmaGrid.assign((size_t)plasmaSize * plasmaSize, 0.0f);
+         plasmaGrid[0] = 0.2f;
+         plasmaGrid[plasmaSize - 1] = 0.8f;
+         plasmaGrid[(size_t)(plasmaSize - 1) * plasmaSize] = 0.4f;
+         plasmaGrid.back() = 0.6f;
+       },
+       [] {
+         std::deque<PlasmaRect> queue = {
+             {0, 0, plasmaSize - 1, plasmaSize - 1, 1.0f}};
+         uint32_t seed = 12345;
+         while (!queue.empty()) {
+           PlasmaRect a = queue.front();
+           queue.pop_front();
+           seed = seed * 1664525u + 1013904223u;
+           float d = (seed >> 8) * (1.0f / 16777216.0f) - 0.5f;
+           float center;
+           PlasmaRect parts[4];
+           if (plasmaStep(plasmaGrid.data(), plasmaSize, a, d, center, parts))
+             queue.insert(queue.end(), parts, parts + 4);
+         }
+         uint64_t h = 0xcbf29ce484222325ull;
+         for (size_t i = 0; i < plasmaGrid.size(); i += 31)
+           h = mix(h, plasmaGrid[i]);
+         return h;
+       }});
+
+  size_t mengerCubes = 1 + 8 + 64 + 512 + 4096 + 32768;
+  list.push_back({"menger_subdivide", mengerCubes, [] {}, [] {
+                    std::vector<MengerCube> cur = {{0, 0, mengerSize}}, nxt;
+                    uint64_t holes = 0, area = 0;
+                    while (!cur.empty()) {
+                      nxt.clear();
+                      for (const MengerCube &c : cur) {
+                        MengerCube hole, parts[8];
+                        if (!mengerSubdivide(c, hole, parts))
+                          continue;
+                        holes++;
+                        area += (uint64_t)hole.size * hole.size;
+                        nxt.insert(nxt.end(), parts, parts + 8);
+                      }
+                      cur.swap(nxt);
+                    }
+                    return holes * 0x9e3779b97f4a7c15ull ^ area;
+                  }});
+
+  size_t sierpinskiTris = 0;
+  for (int i = 0, n = 1; i < sierpinskiLevel; ++i, n *= 3)
+    sierpinskiTris += n;
+  list.push_back({"sierpinski_subdivide", sierpinskiTris, [] {}, [] {
+                    std::deque<SierpinskiTriangle> queue = {
+                        {640, 20, 20, 700, 1260, 700, sierpinskiLevel}};
+                    uint64_t h = 0xcbf29ce484222325ull;
+                    while (!queue.empty()) {
+                      SierpinskiTriangle t = queue.front();
+                      queue.pop_front();
+                      if (t.level <= 0)
+                        continue;
+                      SierpinskiTriangle hole, parts[3];
+                      sierpinskiSubdivide(t, hole, parts);
+                      h = mix(h, hole.x1 + hole.y3);
+                      queue.insert(queue.end(), parts, parts + 3);
+                    }
+                    return h;
+                  }});
+
+  list.push_back({"tree_expand", ((size_t)1 << treeDepth) - 1,
+                  [] {
+                    size_t n = ((size_t)1 << treeDepth) - 1;
+                    treeEx.assign(n, 0.0f);
+                    treeEy.assign(n, 0.0f);
+                    treeUx.assign(n, 0.0f);
+                    treeUy.assign(n, 0.0f);
+                    treeEx[0] = 640.0f;
+                    treeEy[0] = 520.0f;
+                    treeUy[0] = -1.0f;
+                  },
+                  [] {
+                    const float c = std::cos(0.7f), s = std::sin(0.7f);
+                    float len = 180.0f;
+                    for (int k = 0; k + 1 < treeDepth; ++k) {
+                      size_t p = ((size_t)1 << k) - 1;
+                      size_t q = ((size_t)1 << (k + 1)) - 1;
+                      len *= 0.7f;
+                      treeExpandLevel({&treeEx[p], &treeEy[p], &treeUx[p],
+                                       &treeUy[p]},
+                                      (size_t)1 << k, c, s, len,
+                                      {&treeEx[q], &treeEy[q], &treeUx[q],
+                                       &treeUy[q]});
+                    }
+                    uint64_t h = 0xcbf29ce484222325ull;
+                    for (size_t i = 0; i < treeEx.size(); i += 1021)
+                      h = mix(mix(h, treeEx[i]), treeEy[i]);
+                    return h;
+                  }});
+
+  // Chaos game on the Sierpinski IFS with one non-affine variation mixed
+  // in, so the variation loops are part of the measurement.
+  list.push_back({"flame_step", (size_t)flameSteps * flameLanes, [] {}, [] {
+                    static const FlameXform xf[3] = {
+                        {0.5f, 0, 0, 0, 0.5f, 0, 0.9f, 0.1f, 0, 0, 0, 0.0f},
+                        {0.5f, 0, 0.5f, 0, 0.5f, 0, 1, 0, 0, 0, 0, 0.5f},
+                        {0.5f, 0, 0.25f, 0, 0.5f, 0.43f, 1, 0, 0, 0, 0, 1.0f}};
+                    static const float cum[3] = {1 / 3.0f, 2 / 3.0f, 1.0f};
+                    float x[flameLanes] = {}, y[flameLanes] = {},
+                          c[flameLanes] = {};
+                    for (int s = 0; s < flameSteps; ++s)
+                      flameStep(x, y, c, xf, cum, 3,
+                                FLAME_LINEAR | FLAME_SINUSOIDAL, 42,
+                                (uint64_t)s * flameLanes);
+                    uint64_t h = 0xcbf29ce484222325ull;
+                    for (int l = 0; l < flameLanes; ++l)
+                      h = mix(mix(h, x[l]), c[l]);
+                    return h;
+                  }});
+
+  return list;
+}
+
+bool parseArgs(int argc, char **argv, Options &opt) {
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 >= argc)
+      return false;
+    if (!strcmp(argv[i], "--reps"))
+      opt.reps = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--warmup"))
+      opt.warmup = std::max(0, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--filter"))
+      opt.filter = argv[++i];
+    else
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options opt;
+  if (!parseArgs(argc, argv, opt)) {
+    fprintf(stderr,
+            "usage: fractal_bench [--reps N] [--warmup N] [--filter SUBSTR]\n");
+    return 2;
+  }
+
+  std::vector<Result> results;
+  fprintf(stderr, "%-30s %12s %12s %10s %14s\n", "kernel", "median ms",
+          "min ms", "stddev %", "items/s");
+  for (const Bench &b : benches()) {
+    if (opt.filter && !strstr(b.name, opt.filter))
+      continue;
+    Result r = measure(b, opt);
+    fprintf(stderr, "%-30s %12.3f %12.3f %10.2f %14.4g\n", r.name.c_str(),
+            r.medianNs * 1e-6, r.minNs * 1e-6,
+            100.0 * r.stddevNs / std::max(r.meanNs, 1.0),
+            r.items / (r.medianNs * 1e-9));
+    results.push_back(r);
+  }
+
+  printf("{\n  \"suite\": \"fractal-kernels\",\n  \"version\": \"%s\",\n"
+         "  \"reps\": %d,\n  \"warmup\": %d,\n  \"results\": [\n",
+         FRACTAL_VERSION, opt.reps, opt.warmup);
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result &r = results[i];
+    printf("    {\"name\": \"%s\", \"items\": %zu, \"min_ns\": %.0f, "
+           "\"median_ns\": %.0f, \"mean_ns\": %.0f, \"stddev_ns\": %.0f, "
+           "\"items_per_sec\": %.6g, \"checksum\": \"%016llx\"}%s\n",
+           r.name.c_str(), r.items, r.minNs, r.medianNs, r.meanNs, r.stddevNs,
+           r.items / (r.medianNs * 1e-9), (unsigned long long)r.checksum,
+           i + 1 < results.size() ? "," : "");
+  }
+  printf("  ]\n}\n");
+  return 0;
+}
@@ -0,0 +1,366 @@
+#include "export.h"
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "fractals/factory.h"
+
+namespace {
+
+// Large enough that no fractal ever truncates a frame, so the output
+// depends only on dt and not on how fast the machine is.
+constexpr uint32_t export_budget_ms = 60000;
+
+enum class Format { Y4M, PPM };
+
+struct ExportOptions {
+  FractalType type = FractalType::ANIMATED_TREE;
+  int frames = 300;
+  int fps = 30;
+  int width = 1280;
+  int height = 720;
+  Format format = Format::Y4M;
+  int jobs = 0;
+};
+
+void print_usage() {
+  fprintf(stderr,
+          "usage: Fractal --export <1-%d> [--frames N] [--fps N] "
+          "[--size WxH] [--y4m | --ppm] [--jobs N] > out\n",
+          (int)FractalType::COUNT);
+}
+
+bool parse_int(const char *s, int lo, int hi, int &out) {
+  char *end = nullptr;
+  long v = std::strtol(s, &end, 10);
+  if (!s[0] || *end || v < lo || v > hi)
+    return false;
+  out = (int)v;
+  return true;
+}
+
+bool parse_options(int argc, char **argv, ExportOptions &opt) {
+  int idx = 0;
+  if (argc < 3 || !parse_int(argv[2], 1, (int)FractalType::COUNT, idx))
+    return false;
+  opt.type = (FractalType)(idx - 1);
+
+  for (int i = 3; i < argc; ++i) {
+    const char *arg = argv[i];
+    const char *val = i + 1 < argc ? argv[i + 1] : "";
+
+    if (!strcmp(arg, "--ppm")) {
+      opt.format = Format::PPM;
+    } else if (!strcmp(arg, "--y4m")) {
+      opt.format = Format::Y4M;
+    } else if (!strcmp(arg, "--frames")) {
+      if (!parse_int(val, 1, 1 << 24, opt.frames))
+        return false;
+      ++i;
+    } else if (!strcmp(arg, "--fps")) {
+      if (!parse_int(val, 1, 1000, opt.fps))
+        return false;
+      ++i;
+    } else if (!strcmp(arg, "--jobs")) {
+      if (!parse_int(val, 1, 1024, opt.jobs))
+        return false;
+      ++i;
+    } else if (!strcmp(arg, "--size")) {
+      if (sscanf(val, "%dx%d", &opt.width, &opt.height) != 2 ||
+          opt.width < 2 || opt.height < 2 || opt.width > 16384 ||
+          opt.height > 16384)
+        return false;
+      ++i;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A software renderer drawing into its own surface, so every export worker
+// owns an independent SDL rendering context and fractal instance.
+struct Canvas {
+  SDL_Surface *surface = nullptr;
+  SDL_Renderer *ren = nullptr;
+  std::unique_ptr<FractalFB> fractal;
+  std::vector<uint8_t> rgb;
+
+  Canvas() = default;
+  Canvas(const Canvas &) = delete;
+  Canvas &operator=(const Canvas &) = delete;
+
+  ~Canvas() {
+    fractal.reset();
+    if (ren)
+      SDL_DestroyRenderer(ren);
+    if (surface)
+      SDL_FreeSurface(surface);
+  }
+
+  bool open(const ExportOptions &opt) {
+    surface = SDL_CreateRGBSurfaceWithFormat(0, opt.width, opt.height, 32,
+                                             SDL_PIXELFORMAT_RGBA8888);
+    if (!surface)
+      return false;
+    ren = SDL_CreateSoftwareRenderer(surface);
+    if (!ren)
+      return false;
+    fractal = createFractal(opt.type, ren);
+    if (!fractal)
+      return false;
+    fractal->resize(opt.width, opt.height);
+    rgb.resize((size_t)opt.width * opt.height * 3);
+    return true;
+  }
+
+  // Draws the fractal's current state and reads it back as packed RGB.
+  void capture() {
+    SDL_SetRenderTarget(ren, nullptr);
+    SDL_SetRenderDrawColor(ren, 0, 0, 0, 255);
+    SDL_RenderClear(ren);
+    fractal->render();
+    SDL_RenderReadPixels(ren, nullptr, SDL_PIXELFORMAT_RGB24, rgb.data(),
+                         surface->w * 3);
+  }
+};
+
+// BT.601 limited-range 4:2:0, chroma averaged over each 2x2 block.
+void encode_y4m(const std::vector<uint8_t> &rgb, int w, int h,
+                std::vector<uint8_t> &out) {
+  int cw = (w + 1) / 2, ch = (h + 1) / 2;
+  static const char tag[] = "FRAME\n";
+  out.resize(sizeof(tag) - 1 + (size_t)w * h + (size_t)cw * ch * 2);
+
+  std::memcpy(out.data(), tag, sizeof(tag) - 1);
+  uint8_t *py = out.data() + sizeof(tag) - 1;
+  uint8_t *pu = py + (size_t)w * h;
+  uint8_t *pv = pu + (size_t)cw * ch;
+
+  for (int y = 0; y < h; ++y) {
+    const uint8_t *s = rgb.data() + (size_t)y * w * 3;
+    for (int x = 0; x < w; ++x, s += 3)
+      py[(size_t)y * w + x] =
+          (uint8_t)(((66 * s[0] + 129 * s[1] + 25 * s[2] + 128) >> 8) + 16);
+  }
+
+  for (int cy = 0; cy < ch; ++cy) {
+    for (int cx = 0; cx < cw; ++cx) {
+      int r = 0, g = 0, b = 0;
+      for (int dy = 0; dy < 2; ++dy) {
+        for (int dx = 0; dx < 2; ++dx) {
+          int x = std::min(cx * 2 + dx, w - 1);
+          int y = std::min(cy * 2 + dy, h - 1);
+          const uint8_t *s = rgb.data() + ((size_t)y * w + x) * 3;
+          r += s[0];
+          g += s[1];
+          b += s[2];
+        }
+      }
+      r /= 4;
+      g /= 4;
+      b /= 4;
+      pu[(size_t)cy * cw + cx] =
+          (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+      pv[(size_t)cy * cw + cx] =
+          (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+  }
+}
+
+void encode_ppm(const std::vector<uint8_t> &rgb, int w, int h,
+                std::vector<uint8_t> &out) {
+  char header[32];
+  int n = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", w, h);
+  out.resize((size_t)n + rgb.size());
+  std::memcpy(out.data(), header, n);
+  std::memcpy(out.data() + n, rgb.data(), rgb.size());
+}
+
+void encode(const ExportOptions &opt, const std::vector<uint8_t> &rgb,
+            std::vector<uint8_t> &out) {
+  if (opt.format == Format::Y4M)
+    encode_y4m(rgb, opt.width, opt.height, out);
+  else
+    encode_ppm(rgb, opt.width, opt.height, out);
+}
+
+bool write_all(const std::vector<uint8_t> &data) {
+  return fwrite(data.data(), 1, data.size(), stdout) == data.size();
+}
+
+// Frames of a time-pure fractal are independent, so workers each render
+// every frame they claim from their own canvas. Finished frames go into a
+// ring of 2 * jobs slots and are written strictly in order; a worker may
+// not run further ahead of the writer than the ring allows.
+bool export_parallel(const ExportOptions &opt, int jobs) {
+  struct Slot {
+    std::vector<uint8_t> data;
+    int frame = -1;
+  };
+
+  const int window = jobs * 2;
+  std::vector<Slot> slots(window);
+  std::mutex mutex;
+  std::condition_variable cv;
+  int next = 0;
+  int written = 0;
+  bool failed = false;
+
+  auto worker = [&]() {
+    Canvas canvas;
+    bool ok = canvas.open(opt);
+    std::vector<uint8_t> buf;
+
+    for (;;) {
+      std::unique_lock<std::mutex> lock(mutex);
+      if (!ok) {
+        failed = true;
+        cv.notify_all();
+        return;
+      }
+      cv.wait(lock, [&] {
+        return failed || next >= opt.frames || next < written + window;
+      });
+      if (failed || next >= opt.frames)
+        return;
+      int i = next++;
+      lock.unlock();
+
+      canvas.fractal->setTime((double)i / opt.fps);
+      canvas.fractal->update(0.0f, export_budget_ms);
+      canvas.capture();
+      encode(opt, canvas.rgb, buf);
+
+      lock.lock();
+      slots[i % window].data.swap(buf);
+      slots[i % window].frame = i;
+      cv.notify_all();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < jobs; ++t)
+    threads.emplace_back(worker);
+
+  std::vector<uint8_t> out;
+  for (int i = 0; i < opt.frames; ++i) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      Slot &slot = slots[i % window];
+      cv.wait(lock, [&] { return failed || slot.frame == i; });
+      if (failed)
+        break;
+      out.swap(slot.data);
+      slot.frame = -1;
+      written = i + 1;
+      cv.notify_all();
+    }
+    if (!write_all(out)) {
+      std::lock_guard<std::mutex> lock(mutex);
+      failed = true;
+      cv.notify_all();
+      break;
+    }
+  }
+
+  for (auto &t : threads)
+    t.join();
+  return !failed;
+}
+
+// Everything else carries state from frame to frame and is stepped in
+// order on one canvas; the escape-time kernels still use the thread pool.
+bool export_sequential(const ExportOptions &opt, Canvas &canvas) {
+  float dt = 1.0f / opt.fps;
+  std::vector<uint8_t> out;
+
+  for (int i = 0; i < opt.frames; ++i) {
+    canvas.fractal->update(i == 0 ? 0.0f : dt, export_budget_ms);
+    canvas.capture();
+    encode(opt, canvas.rgb, out);
+    if (!write_all(out))
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int run_export(int argc, char **argv) {
+  ExportOptions opt;
+  if (!parse_options(argc, argv, opt)) {
+    print_usage();
+    return 2;
+  }
+
+  if (isatty(STDOUT_FILENO)) {
+    fprintf(stderr, "export: refusing to write video to a terminal\n");
+    print_usage();
+    return 2;
+  }
+
+  // A cached render would skip the reveal the export is meant to capture.
+  setenv("FRACTAL_DISK_CACHE", "0", 1);
+
+  if (SDL_Init(0) != 0) {
+    fprintf(stderr, "export: %s\n", SDL_GetError());
+    return 1;
+  }
+
+  int ret = 0;
+  {
+    Canvas probe;
+    if (!probe.open(opt)) {
+      fprintf(stderr, "export: %s\n", SDL_GetError());
+      SDL_Quit();
+      return 1;
+    }
+
+    bool timePure = probe.fractal->setTime(0.0);
+    int jobs = 1;
+    if (timePure) {
+      jobs = opt.jobs > 0
+                 ? opt.jobs
+                 : (int)std::max(1u, std::thread::hardware_concurrency());
+      jobs = std::min(jobs, opt.frames);
+    }
+
+    if (opt.format == Format::Y4M)
+      printf("YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", opt.width,
+             opt.height, opt.fps);
+
+    auto start = std::chrono::steady_clock::now();
+    bool ok = timePure ? export_parallel(opt, jobs)
+                       : export_sequential(opt, probe);
+    ok = fflush(stdout) == 0 && ok;
+    double secs = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+
+    if (ok) {
+      fprintf(stderr,
+              "export: %s, %d frames at %dx%d in %.2fs (%.1f fps, %d %s)\n",
+              getFractalName(opt.type), opt.frames, opt.width, opt.height,
+              secs, opt.frames / std::max(secs, 1e-9), jobs,
+              jobs == 1 ? "thread" : "threads");
+    } else {
+      fprintf(stderr, "export: failed after %.2fs\n", secs);
+      ret = 1;
+    }
+  }
+
+  SDL_Quit();
+  return ret;
+}
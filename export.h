@@ -0,0 +1,6 @@
+#pragma once
+
+// Headless frame-sequence export: `Fractal --export ...` renders a fixed
+// number of frames at a fixed timestep with a software renderer and writes
+// them to stdout as a Y4M or concatenated PPM stream.
+int run_export(int argc, char **argv);
@@ -0,0 +1,567 @@
+#include "farm.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "fractals/factory.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Every message is a Header followed by `size` payload bytes. Both ends
+// run on the same machine, so fields are in host byte order. A worker
+// opens with HELLO and is sent one JOB; after that each TILE it is sent is
+// answered with a RESULT: the tile id followed by w * h float values in
+// row order. Closing the socket ends the worker.
+enum class Msg : uint32_t { HELLO = 1, JOB, TILE, RESULT };
+
+struct Header {
+  uint32_t type;
+  uint32_t size;
+};
+
+struct HelloMsg {
+  uint32_t magic;
+  uint32_t version;
+  int32_t pid;
+};
+
+struct JobMsg {
+  uint32_t fractal;
+  uint32_t width, height;
+};
+
+struct TileMsg {
+  uint32_t id;
+  uint32_t x, y, w, h;
+};
+
+constexpr uint32_t farm_magic = 0x4d524146;
+constexpr uint32_t farm_version = 1;
+
+// A tile is given up on once this many workers have died holding it.
+constexpr int max_attempts = 3;
+constexpr int poll_interval_ms = 100;
+
+struct FarmOptions {
+  FractalType type = FractalType::MANDELBROT;
+  int width = 3840;
+  int height = 2160;
+  int tile = 128;
+  int workers = 0;
+  std::string socket_path;
+};
+
+void print_usage() {
+  fprintf(stderr,
+          "usage: Fractal --farm <1-%d> [--size WxH] [--tile N] "
+          "[--workers N] [--socket PATH] > out.ppm\n"
+          "       Fractal --farm-worker PATH\n",
+          (int)FractalType::COUNT);
+}
+
+bool parse_int(const char *s, int lo, int hi, int &out) {
+  char *end = nullptr;
+  long v = std::strtol(s, &end, 10);
+  if (!s[0] || *end || v < lo || v > hi)
+    return false;
+  out = (int)v;
+  return true;
+}
+
+bool parse_options(int argc, char **argv, FarmOptions &opt) {
+  int idx = 0;
+  if (argc < 3 || !parse_int(argv[2], 1, (int)FractalType::COUNT, idx))
+    return false;
+  opt.type = (FractalType)(idx - 1);
+
+  for (int i = 3; i < argc; ++i) {
+    const char *arg = argv[i];
+    const char *val = i + 1 < argc ? argv[i + 1] : "";
+
+    if (!strcmp(arg, "--tile")) {
+      if (!parse_int(val, 8, 4096, opt.tile))
+        return false;
+    } else if (!strcmp(arg, "--workers")) {
+      if (!parse_int(val, 0, 1024, opt.workers))
+        return false;
+    } else if (!strcmp(arg, "--socket")) {
+      if (!val[0])
+        return false;
+      opt.socket_path = val;
+    } else if (!strcmp(arg, "--size")) {
+      if (sscanf(val, "%dx%d", &opt.width, &opt.height) != 2 ||
+          opt.width < 2 || opt.height < 2 || opt.width > 65536 ||
+          opt.height > 65536)
+        return false;
+    } else {
+      return false;
+    }
+    ++i;
+  }
+  return true;
+}
+
+bool write_all(int fd, const void *data, size_t n) {
+  const char *p = (const char *)data;
+  while (n > 0) {
+    ssize_t k = send(fd, p, n, MSG_NOSIGNAL);
+    if (k < 0 && errno == EINTR)
+      continue;
+    if (k <= 0)
+      return false;
+    p += k;
+    n -= (size_t)k;
+  }
+  return true;
+}
+
+bool read_all(int fd, void *data, size_t n) {
+  char *p = (char *)data;
+  while (n > 0) {
+    ssize_t k = recv(fd, p, n, 0);
+    if (k < 0 && errno == EINTR)
+      continue;
+    if (k <= 0)
+      return false;
+    p += k;
+    n -= (size_t)k;
+  }
+  return true;
+}
+
+bool send_msg(int fd, Msg type, const void *a, size_t an,
+              const void *b = nullptr, size_t bn = 0) {
+  Header h = {(uint32_t)type, (uint32_t)(an + bn)};
+  return write_all(fd, &h, sizeof(h)) && write_all(fd, a, an) &&
+         (bn == 0 || write_all(fd, b, bn));
+}
+
+bool set_address(sockaddr_un &addr, const std::string &path) {
+  if (path.size() >= sizeof(addr.sun_path))
+    return false;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+std::string self_exe(const char *argv0) {
+  char buf[4096];
+  ssize_t n = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+  if (n <= 0)
+    return argv0;
+  buf[n] = 0;
+  return buf;
+}
+
+pid_t spawn_worker(const std::string &exe, const std::string &path) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    execl(exe.c_str(), exe.c_str(), "--farm-worker", path.c_str(),
+          (char *)nullptr);
+    _exit(127);
+  }
+  return pid;
+}
+
+struct Tile {
+  int x, y, w, h;
+  int copies = 0;
+  int attempts = 0;
+  bool done = false;
+  Clock::time_point started;
+};
+
+struct Worker {
+  int fd;
+  bool ready = false;
+  int tile = -1;
+  std::vector<char> in;
+};
+
+// Hands out tiles and collects results until every tile is done. Workers
+// that die have their tile put back at the front of the queue. Once the
+// queue is empty, an idle worker is given a copy of the tile that has run
+// longest, if it has run longer than a tile takes on average; whichever
+// copy finishes first is kept.
+class Coordinator {
+public:
+  Coordinator(const FarmOptions &opt, const Fractal &fractal,
+              std::vector<uint32_t> &frame)
+      : opt(opt), fractal(fractal), frame(frame) {
+    for (int y = 0; y < opt.height; y += opt.tile)
+      for (int x = 0; x < opt.width; x += opt.tile)
+        tiles.push_back({x, y, std::min(opt.tile, opt.width - x),
+                         std::min(opt.tile, opt.height - y), 0, 0, false,
+                         {}});
+    for (int i = 0; i < (int)tiles.size(); ++i)
+      queue.push_back(i);
+  }
+
+  ~Coordinator() {
+    for (Worker &w : workers)
+      close(w.fd);
+    if (listener >= 0) {
+      close(listener);
+      unlink(opt.socket_path.c_str());
+    }
+    // Every tile is in by now, so a worker still busy with a stolen copy,
+    // or hung, is not waited for.
+    for (pid_t pid : children) {
+      kill(pid, SIGKILL);
+      waitpid(pid, nullptr, 0);
+    }
+  }
+
+  bool run(const std::string &exe) {
+    sockaddr_un addr;
+    if (!set_address(addr, opt.socket_path)) {
+      fprintf(stderr, "farm: socket path too long\n");
+      return false;
+    }
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(opt.socket_path.c_str());
+    if (listener < 0 || bind(listener, (sockaddr *)&addr, sizeof(addr)) ||
+        listen(listener, 64)) {
+      fprintf(stderr, "farm: %s: %s\n", opt.socket_path.c_str(),
+              strerror(errno));
+      return false;
+    }
+
+    for (int i = 0; i < opt.workers; ++i)
+      children.push_back(spawn_worker(exe, opt.socket_path));
+    int respawnsLeft = 2 * opt.workers;
+
+    while (doneCount < tiles.size()) {
+      assign();
+
+      std::vector<pollfd> fds = {{listener, POLLIN, 0}};
+      for (const Worker &w : workers)
+        fds.push_back({w.fd, POLLIN, 0});
+      if (poll(fds.data(), fds.size(), poll_interval_ms) < 0 &&
+          errno != EINTR)
+        return false;
+
+      if (fds[0].revents & POLLIN) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd >= 0)
+          workers.push_back({fd, false, -1, {}});
+      }
+
+      // Walk backwards so dropping a worker does not shift the ones left.
+      for (size_t k = fds.size() - 1; k > 0; --k) {
+        if (fds[k].revents && !receive(workers[k - 1])) {
+          drop(k - 1);
+          if (failed)
+            return false;
+        }
+      }
+
+      int status;
+      pid_t pid;
+      while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        children.erase(std::remove(children.begin(), children.end(), pid),
+                       children.end());
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+          continue;
+        deaths++;
+        if (respawnsLeft > 0 && doneCount < tiles.size()) {
+          respawnsLeft--;
+          children.push_back(spawn_worker(exe, opt.socket_path));
+        }
+      }
+
+      if (children.empty() && workers.empty()) {
+        fprintf(stderr, "farm: no workers left\n");
+        return false;
+      }
+    }
+    return true;
+  }
+
+  size_t tileCount() const { return tiles.size(); }
+  int workerDeaths() const { return deaths; }
+  int retried() const { return retries; }
+  int stolen() const { return steals; }
+  int wasted() const { return duplicates; }
+
+private:
+  void assign() {
+    for (Worker &w : workers) {
+      if (!w.ready || w.tile >= 0)
+        continue;
+      int id = -1;
+      while (!queue.empty() && id < 0) {
+        id = queue.front();
+        queue.pop_front();
+        if (tiles[id].done)
+          id = -1;
+      }
+      bool steal = id < 0;
+      if (steal && (id = slowestTile()) < 0)
+        return;
+
+      // A failed send means the worker is gone; poll() reports it next.
+      Tile &t = tiles[id];
+      TileMsg msg = {(uint32_t)id, (uint32_t)t.x, (uint32_t)t.y,
+                     (uint32_t)t.w, (uint32_t)t.h};
+      if (!send_msg(w.fd, Msg::TILE, &msg, sizeof(msg))) {
+        if (!steal)
+          queue.push_front(id);
+        continue;
+      }
+      steals += steal;
+      if (t.copies++ == 0)
+        t.started = Clock::now();
+      w.tile = id;
+    }
+  }
+
+  int slowestTile() const {
+    if (doneCount == 0)
+      return -1;
+    double average = busySeconds / doneCount;
+    Clock::time_point now = Clock::now();
+    int best = -1;
+    for (const Worker &w : workers) {
+      if (w.tile < 0)
+        continue;
+      const Tile &t = tiles[w.tile];
+      double ran = std::chrono::duration<double>(now - t.started).count();
+      if (!t.done && t.copies == 1 && ran > average &&
+          (best < 0 || t.started < tiles[best].started))
+        best = w.tile;
+    }
+    return best;
+  }
+
+  // Reads whatever has arrived and handles every complete message in it.
+  // Returns false once the worker is gone or breaks the protocol.
+  bool receive(Worker &w) {
+    char buf[65536];
+    ssize_t k = recv(w.fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (k < 0 && (errno == EAGAIN || errno == EINTR))
+      return true;
+    if (k <= 0)
+      return false;
+    w.in.insert(w.in.end(), buf, buf + k);
+
+    size_t pos = 0;
+    while (w.in.size() - pos >= sizeof(Header)) {
+      Header h;
+      memcpy(&h, &w.in[pos], sizeof(h));
+      if (w.in.size() - pos - sizeof(h) < h.size)
+        break;
+      if (!handle(w, (Msg)h.type, &w.in[pos + sizeof(h)], h.size))
+        return false;
+      pos += sizeof(h) + h.size;
+    }
+    w.in.erase(w.in.begin(), w.in.begin() + pos);
+    return true;
+  }
+
+  bool handle(Worker &w, Msg type, const char *data, size_t size) {
+    if (type == Msg::HELLO) {
+      HelloMsg hello;
+      if (w.ready || size != sizeof(hello))
+        return false;
+      memcpy(&hello, data, size);
+      if (hello.magic != farm_magic || hello.version != farm_version)
+        return false;
+      JobMsg job = {(uint32_t)opt.type, (uint32_t)opt.width,
+                    (uint32_t)opt.height};
+      w.ready = send_msg(w.fd, Msg::JOB, &job, sizeof(job));
+      return w.ready;
+    }
+
+    uint32_t id;
+    if (type != Msg::RESULT || size < sizeof(id))
+      return false;
+    memcpy(&id, data, sizeof(id));
+    if (id >= tiles.size() || (int)id != w.tile)
+      return false;
+    Tile &t = tiles[id];
+    if (size != sizeof(id) + (size_t)t.w * t.h * sizeof(float))
+      return false;
+
+    w.tile = -1;
+    t.copies--;
+    if (t.done) {
+      duplicates++;
+      return true;
+    }
+
+    std::vector<float> values((size_t)t.w * t.h);
+    memcpy(values.data(), data + sizeof(id), values.size() * sizeof(float));
+    for (int y = 0; y < t.h; ++y)
+      fractal.colorTile(&values[(size_t)y * t.w], t.w,
+                        &frame[(size_t)(t.y + y) * opt.width + t.x]);
+
+    t.done = true;
+    doneCount++;
+    busySeconds +=
+        std::chrono::duration<double>(Clock::now() - t.started).count();
+    return true;
+  }
+
+  void drop(size_t k) {
+    Worker &w = workers[k];
+    if (w.tile >= 0) {
+      Tile &t = tiles[w.tile];
+      t.copies--;
+      if (!t.done && t.copies == 0) {
+        if (++t.attempts >= max_attempts) {
+          fprintf(stderr, "farm: tile at %d,%d failed on %d workers\n", t.x,
+                  t.y, t.attempts);
+          failed = true;
+        }
+        queue.push_front(w.tile);
+        retries++;
+      }
+    }
+    close(w.fd);
+    workers.erase(workers.begin() + k);
+  }
+
+  const FarmOptions &opt;
+  const Fractal &fractal;
+  std::vector<uint32_t> &frame;
+
+  std::vector<Tile> tiles;
+  std::deque<int> queue;
+  std::vector<Worker> workers;
+  std::vector<pid_t> children;
+  int listener = -1;
+
+  size_t doneCount = 0;
+  double busySeconds = 0.0;
+  int deaths = 0, retries = 0, steals = 0, duplicates = 0;
+  bool failed = false;
+};
+
+} // namespace
+
+int run_farm_worker(int argc, char **argv) {
+  sockaddr_un addr;
+  if (argc < 3 || !set_address(addr, argv[2])) {
+    print_usage();
+    return 2;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr))) {
+    fprintf(stderr, "farm-worker: %s: %s\n", argv[2], strerror(errno));
+    return 1;
+  }
+
+  HelloMsg hello = {farm_magic, farm_version, (int32_t)getpid()};
+  if (!send_msg(fd, Msg::HELLO, &hello, sizeof(hello)))
+    return 1;
+
+  std::unique_ptr<Fractal> fractal;
+  JobMsg job{};
+  std::vector<float> values;
+  Header h;
+
+  while (read_all(fd, &h, sizeof(h))) {
+    if ((Msg)h.type == Msg::JOB && h.size == sizeof(job)) {
+      if (!read_all(fd, &job, sizeof(job)))
+        break;
+      fractal = createFractal((FractalType)job.fractal, nullptr);
+    } else if ((Msg)h.type == Msg::TILE && h.size == sizeof(TileMsg)) {
+      TileMsg t;
+      if (!read_all(fd, &t, sizeof(t)) || !fractal)
+        break;
+      values.resize((size_t)t.w * t.h);
+      if (!fractal->computeTile(job.width, job.height, t.x, t.y, t.w, t.h,
+                                values.data()) ||
+          !send_msg(fd, Msg::RESULT, &t.id, sizeof(t.id), values.data(),
+                    values.size() * sizeof(float)))
+        break;
+    } else {
+      fprintf(stderr, "farm-worker: bad message %u\n", h.type);
+      close(fd);
+      return 1;
+    }
+  }
+
+  close(fd);
+  return 0;
+}
+
+int run_farm(int argc, char **argv) {
+  FarmOptions opt;
+  if (!parse_options(argc, argv, opt)) {
+    print_usage();
+    return 2;
+  }
+
+  if (isatty(STDOUT_FILENO)) {
+    fprintf(stderr, "farm: refusing to write an image to a terminal\n");
+    print_usage();
+    return 2;
+  }
+
+  std::unique_ptr<Fractal> fractal = createFractal(opt.type, nullptr);
+  if (!fractal || !fractal->computeTile(opt.width, opt.height, 0, 0, 0, 0,
+                                        nullptr)) {
+    fprintf(stderr, "farm: %s is not an escape-time fractal\n",
+            getFractalName(opt.type));
+    return 2;
+  }
+
+  if (opt.workers == 0)
+    opt.workers = (int)std::max(1u, std::thread::hardware_concurrency());
+  if (opt.socket_path.empty())
+    opt.socket_path = "/tmp/fractal-farm-" + std::to_string(getpid());
+
+  std::vector<uint32_t> frame((size_t)opt.width * opt.height);
+  auto start = Clock::now();
+  Coordinator farm(opt, *fractal, frame);
+  if (!farm.run(self_exe(argv[0]))) {
+    fprintf(stderr, "farm: failed\n");
+    return 1;
+  }
+  double secs = std::chrono::duration<double>(Clock::now() - start).count();
+
+  printf("P6\n%d %d\n255\n", opt.width, opt.height);
+  std::vector<uint8_t> row((size_t)opt.width * 3);
+  for (int y = 0; y < opt.height; ++y) {
+    for (int x = 0; x < opt.width; ++x) {
+      uint32_t c = frame[(size_t)y * opt.width + x];
+      row[x * 3] = (uint8_t)(c >> 24);
+      row[x * 3 + 1] = (uint8_t)(c >> 16);
+      row[x * 3 + 2] = (uint8_t)(c >> 8);
+    }
+    fwrite(row.data(), 1, row.size(), stdout);
+  }
+  if (fflush(stdout) != 0)
+    return 1;
+
+  fprintf(stderr,
+          "farm: %s at %dx%d, %zu tiles on %d workers in %.2fs "
+          "(%d worker deaths, %d retried, %d stolen, %d duplicates)\n",
+          getFractalName(opt.type), opt.width, opt.height, farm.tileCount(),
+          opt.workers, secs, farm.workerDeaths(), farm.retried(),
+          farm.stolen(), farm.wasted());
+  return 0;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+// Multi-process tile rendering for the escape-time fractals. `Fractal
+// --farm ...` splits one frame into tiles, hands them to worker processes
+// over a Unix domain socket and writes the frame to stdout as a PPM. The
+// coordinator starts its own workers; more can be attached to a running
+// farm with `Fractal --farm-worker <socket>`, e.g. under numactl.
+int run_farm(int argc, char **argv);
+int run_farm_worker(int argc, char **argv);
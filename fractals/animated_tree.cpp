@@ -1,36 +1,98 @@
-#include "fractal.h"
+#include "budget.h"
+#include "kernels.h"
+#include "line_raster.h"
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <vector>
 
-class AnimatedTree : public FractalFB {
+class AnimatedTree : public LineFractal {
 public:
-  explicit AnimatedTree(SDL_Renderer *r) : FractalFB(r) {}
+  explicit AnimatedTree(SDL_Renderer *r, int d = defaultDepth)
+      : LineFractal(r) {
+    setDepth(d);
+  }
 
   void reset() override {
     time = 0.0;
-    clear();
+    timeSet = false;
+    clearCanvas();
   }
 
-  bool update(float dt, uint32_t) override {
-    time += dt * animSpeed;
+  bool update(float dt, uint32_t maxMs) override {
+    FrameBudget budget(maxMs);
+    if (!timeSet)
+      time += dt * animSpeed;
+    timeSet = false;
 
-    clear();
-    SDL_SetRenderTarget(renderer, texture);
+    clearCanvas();
 
     double spread = angleBase + std::sin(time) * angleAmp;
 
-    drawRecursive(width * 0.5, height * 0.98, startLen, -M_PI / 2.0, spread,
-                  depth);
+    buildGeometry(spread, budget);
+    drawGeometry(budget);
+    counters.levelsDropped += depth - builtDepth;
+    flushLines();
+    return true;
+  }
+
+  bool handleKey(SDL_Keycode key) override {
+    if (key == SDLK_LEFTBRACKET) {
+      setDepth(depth - 1);
+      return true;
+    }
+    if (key == SDLK_RIGHTBRACKET) {
+      setDepth(depth + 1);
+      return true;
+    }
+    return false;
+  }
+
+  void setDepth(int d) {
+    depth = std::clamp(d, 1, maxDepth);
+    size_t nodes = ((size_t)1 << depth) - 1;
+    ex.resize(nodes);
+    ey.resize(nodes);
+    ux.resize(nodes);
+    uy.resize(nodes);
+  }
+
+  int getDepth() const { return depth; }
+
+  std::string getStatus() const override {
+    char buf[128];
+    if (builtDepth < depth)
+      snprintf(buf, sizeof(buf), "Depth: %d (budget: %d) | Segments: %zu",
+               depth, builtDepth, ((size_t)1 << builtDepth) - 1);
+    else
+      snprintf(buf, sizeof(buf), "Depth: %d | Segments: %zu", depth,
+               ex.size());
+    return buf;
+  }
+
+  bool isAnimated() const override { return true; }
 
-    SDL_SetRenderTarget(renderer, nullptr);
+  bool setTime(double t) override {
+    time = t * animSpeed;
+    timeSet = true;
     return true;
   }
 
+  size_t memoryBytes() const override {
+    return LineFractal::memoryBytes() +
+           (ex.capacity() + ey.capacity() + ux.capacity() + uy.capacity()) *
+               sizeof(float);
+  }
+
   const char *getName() const override { return "Animated Fractal Tree"; }
 
 private:
   double time = 0.0;
+  bool timeSet = false;
+  int depth = defaultDepth;
 
-  static constexpr int depth = 11;
+  static constexpr int defaultDepth = 11;
+  static constexpr int maxDepth = 22;
   static constexpr double startLen = 180.0;
   static constexpr double lenShrink = 0.70;
 
@@ -38,24 +100,87 @@ private:
   static constexpr double angleBase = 0.5;
   static constexpr double angleAmp = 0.5;
 
-  void drawRecursive(double x, double y, double len, double angle,
-                     double spread, int d) {
+  // Breadth-first node storage. Level k holds 2^k nodes starting at
+  // 2^k - 1, laid out as [left children][right children], so the parent of
+  // node i in a level of size 2n is i % n.
+  std::vector<float> ex, ey;
+  std::vector<float> ux, uy;
+  float rootX = 0.0f, rootY = 0.0f;
+  int builtDepth = 0;
 
-    if (d == 0)
-      return;
+  // Every frame is drawn from scratch at the current size, so a resize,
+  // including a render-scale change, keeps the animation time.
+  bool reproject(int, int) override { return true; }
 
-    double x2 = x + len * std::cos(angle);
-    double y2 = y + len * std::sin(angle);
+  static size_t levelBase(int k) { return ((size_t)1 << k) - 1; }
 
-    int c = (d * 20 + int(time * 25)) & 0xFF;
-    SDL_SetRenderDrawColor(renderer, c, (c + 80) & 0xFF, (c + 160) & 0xFF, 255);
-
-    SDL_RenderDrawLine(renderer, int(x), int(y), int(x2), int(y2));
-
-    double nextLen = len * lenShrink;
+  TreeNodes level(int k) {
+    size_t b = levelBase(k);
+    return {ex.data() + b, ey.data() + b, ux.data() + b, uy.data() + b};
+  }
 
-    drawRecursive(x2, y2, nextLen, angle - spread, spread, d - 1);
+  // The only per-frame trigonometry is the single rotation by `spread`;
+  // every other direction is the parent direction rotated left or right.
+  // Levels are built until the budget runs out; the frame then shows the
+  // levels that made it.
+  void buildGeometry(double spread, const FrameBudget &budget) {
+    const float c = (float)std::cos(spread);
+    const float s = (float)std::sin(spread);
+
+    rootX = (float)(width * 0.5);
+    rootY = (float)(height * 0.98);
+    ux[0] = 0.0f;
+    uy[0] = -1.0f;
+    ex[0] = rootX;
+    ey[0] = rootY - (float)(startLen * renderScale);
+
+    builtDepth = 1;
+    float len = (float)(startLen * renderScale);
+    for (int k = 0; k + 1 < depth; ++k) {
+      if (budget.expired())
+        break;
+      len *= (float)lenShrink;
+
+      treeExpandLevel(level(k), (size_t)1 << k, c, s, len, level(k + 1));
+      counters.iterations += (size_t)1 << k;
+      builtDepth = k + 2;
+    }
+  }
 
-    drawRecursive(x2, y2, nextLen, angle + spread, spread, d - 1);
+  // Levels whose branches are shorter than a pixel are queued as points
+  // instead of lines. Queueing is coarse to fine, so running out of budget
+  // only drops the finest levels.
+  void drawGeometry(const FrameBudget &budget) {
+    float len = (float)(startLen * renderScale);
+    for (int k = 0; k < builtDepth; ++k) {
+      if (k > 0 && budget.expired()) {
+        builtDepth = k;
+        break;
+      }
+
+      int d = depth - k;
+      int col = (d * 20 + int(time * 25)) & 0xFF;
+      uint32_t color =
+          Palette::rgba(col, (col + 80) & 0xFF, (col + 160) & 0xFF);
+
+      size_t n = (size_t)1 << k;
+      size_t base = levelBase(k);
+
+      if (k == 0) {
+        drawLine(rootX, rootY, ex[0], ey[0], color);
+      } else if (len >= 1.0f) {
+        size_t pbase = levelBase(k - 1);
+        size_t half = n / 2;
+        for (size_t i = 0; i < n; ++i) {
+          size_t p = pbase + i % half;
+          drawLine(ex[p], ey[p], ex[base + i], ey[base + i], color);
+        }
+      } else {
+        for (size_t i = 0; i < n; ++i)
+          drawPoint(ex[base + i], ey[base + i], color);
+      }
+
+      len *= (float)lenShrink;
+    }
   }
 };
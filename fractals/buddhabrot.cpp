@@ -0,0 +1,299 @@
+#include "budget.h"
+#include "fractal.h"
+#include "kernels.h"
+#include "palette.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Density of escaping Mandelbrot orbits (or, in anti mode, of bounded
+// ones). Every pool worker runs its own sampler into a private histogram;
+// these are folded into the shared image a few times a second of wall
+// time, each merge task owning a disjoint pixel range, so sampling never
+// takes a lock. The private histograms are capped at
+// ThreadPool::privateBufferBytes in total, which limits how many workers
+// sample at large sizes. Sampling stops at targetPerPixel samples per
+// pixel.
+//
+// With Metropolis-Hastings on, each worker keeps a Markov chain over c
+// whose stationary density is proportional to how many orbit points land
+// on screen. Proposals are either small log-uniformly sized mutations or
+// uniform jumps, both symmetric, and every step deposits the current orbit
+// with weight 1 / hits, which keeps the image unbiased.
+class Buddhabrot : public FractalFB {
+public:
+  Buddhabrot(SDL_Renderer *r) : FractalFB(r), palette(Palette::Preset::GRAY) {}
+
+  struct Stats {
+    uint64_t samples, orbitSteps, proposals, accepted;
+    double samplingSeconds;
+  };
+
+  void reset() override {
+    size_t n = (size_t)width * height;
+    int workers = ThreadPool::instance().workersFor(n * sizeof(float));
+
+    image.assign(n, 0.0);
+    pixels.assign(n, Palette::rgba(0, 0, 0));
+    histograms.assign(workers, std::vector<float>(n, 0.0f));
+    chains.assign(workers, Chain{});
+    for (int t = 0; t < workers; ++t) {
+      chains[t].rng = 0x9e3779b97f4a7c15ull * (t + 1) + generation;
+      chains[t].orbit.resize(2 * (size_t)maxIter());
+    }
+    generation++;
+
+    scale = std::max(3.0 / width, 2.6 / height);
+    stats = {};
+    lastMerge = SDL_GetPerformanceCounter();
+    converged = false;
+    clear();
+  }
+
+  bool update(float, uint32_t maxMs) override {
+    if (converged)
+      return false;
+
+    FrameBudget budget(maxMs);
+
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now - lastMerge >=
+        (Uint64)(displayInterval * SDL_GetPerformanceFrequency())) {
+      lastMerge = now;
+      merge();
+      toneMap();
+      if (stats.samples >= targetPerPixel * (uint64_t)width * height) {
+        converged = true;
+        return false;
+      }
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    ThreadPool::instance().run((int)chains.size(),
+                               [&](int t) { sampleChain(t, budget); });
+    stats.samplingSeconds += double(SDL_GetPerformanceCounter() - start) /
+                             SDL_GetPerformanceFrequency();
+
+    for (Chain &c : chains) {
+      stats.samples += c.samples;
+      stats.orbitSteps += c.steps;
+      counters.iterations += c.steps;
+      stats.proposals += c.proposals;
+      stats.accepted += c.accepted;
+      c.samples = c.steps = c.proposals = c.accepted = 0;
+    }
+    return true;
+  }
+
+  bool handleKey(SDL_Keycode key) override {
+    switch (key) {
+    case SDLK_b:
+      anti = !anti;
+      reset();
+      return true;
+    case SDLK_m:
+      metropolis = !metropolis;
+      reset();
+      return true;
+    case SDLK_c:
+      palette.next();
+      toneMap();
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  std::string getStatus() const override {
+    double secs = std::max(stats.samplingSeconds, 1e-9);
+    char buf[160];
+    int n = snprintf(buf, sizeof(buf),
+                     "%s | Samples: %.1fM (%.2fM/s) | Orbit steps: %.0fM/s",
+                     metropolis ? "MH" : "Uniform", stats.samples * 1e-6,
+                     stats.samples * 1e-6 / secs,
+                     stats.orbitSteps * 1e-6 / secs);
+    if (metropolis && stats.proposals > 0)
+      n += snprintf(buf + n, sizeof(buf) - n, " | Accept: %.0f%%",
+                    100.0 * stats.accepted / stats.proposals);
+    if (converged)
+      snprintf(buf + n, sizeof(buf) - n, " | Done");
+    return buf;
+  }
+
+  const Stats &getStats() const { return stats; }
+
+  size_t memoryBytes() const override {
+    size_t bytes = FractalFB::memoryBytes() +
+                   image.capacity() * sizeof(double) +
+                   pixels.capacity() * sizeof(uint32_t);
+    for (const auto &h : histograms)
+      bytes += h.capacity() * sizeof(float);
+    for (const Chain &c : chains)
+      bytes += c.orbit.capacity() * sizeof(double) +
+               (c.hits.capacity() + c.trial.capacity()) * sizeof(int);
+    return bytes;
+  }
+
+  const char *getName() const override {
+    return anti ? "Anti-Buddhabrot" : "Buddhabrot";
+  }
+
+private:
+  struct Chain {
+    uint64_t rng = 0;
+    double cx = 0.0, cy = 0.0;
+    bool valid = false;
+    std::vector<double> orbit;
+    std::vector<int> hits, trial;
+    uint64_t samples = 0, steps = 0, proposals = 0, accepted = 0;
+  };
+
+  int maxIter() const { return anti ? 500 : 2000; }
+
+  static uint64_t nextRandom(uint64_t &s) {
+    uint64_t z = (s += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  static double uniform(uint64_t &s) {
+    return (nextRandom(s) >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  // Traces the orbit of c and collects the pixels it lands on, mirrored
+  // across the real axis. Orbits of the wrong kind for the mode get none.
+  void collectHits(Chain &ch, double cx, double cy, std::vector<int> &out) {
+    out.clear();
+    if (!anti && inMainBulbs(cx, cy)) {
+      ch.steps += 1;
+      return;
+    }
+
+    int n = traceOrbit(cx, cy, maxIter(), ch.orbit.data());
+    ch.steps += n ? n : maxIter();
+    if (anti ? n != 0 : n < minIter)
+      return;
+
+    int count = n ? n : maxIter();
+    double inv = 1.0 / scale;
+    for (int i = 0; i < count; ++i) {
+      int px = (int)((ch.orbit[2 * i] - centerX) * inv + width * 0.5);
+      int py = (int)(ch.orbit[2 * i + 1] * inv + height * 0.5);
+      if (px < 0 || px >= width || py < 0 || py >= height)
+        continue;
+      out.push_back(py * width + px);
+      out.push_back((height - 1 - py) * width + px);
+    }
+  }
+
+  void sampleChain(int t, const FrameBudget &budget) {
+    Chain &ch = chains[t];
+    float *hist = histograms[t].data();
+
+    while (!budget.expired()) {
+      for (int k = 0; k < batch; ++k) {
+        double cx, cy;
+        bool jump = !ch.valid || !metropolis || uniform(ch.rng) < jumpRate;
+        if (jump) {
+          cx = -2.0 + 4.0 * uniform(ch.rng);
+          cy = -2.0 + 4.0 * uniform(ch.rng);
+        } else {
+          // Log-uniform radius between a quarter pixel and 0.1.
+          double r = 0.25 * scale * std::pow(0.1 / (0.25 * scale),
+                                             uniform(ch.rng));
+          double a = 6.283185307179586 * uniform(ch.rng);
+          cx = ch.cx + r * std::cos(a);
+          cy = ch.cy + r * std::sin(a);
+        }
+
+        collectHits(ch, cx, cy, ch.trial);
+        ch.samples++;
+
+        if (!metropolis) {
+          for (int idx : ch.trial)
+            hist[idx] += 1.0f;
+          continue;
+        }
+
+        ch.proposals++;
+        if (!ch.trial.empty() &&
+            (!ch.valid || uniform(ch.rng) * ch.hits.size() < ch.trial.size())) {
+          ch.cx = cx;
+          ch.cy = cy;
+          ch.hits.swap(ch.trial);
+          ch.valid = true;
+          ch.accepted++;
+        }
+
+        if (ch.valid) {
+          float w = 1.0f / ch.hits.size();
+          for (int idx : ch.hits)
+            hist[idx] += w;
+        }
+      }
+    }
+  }
+
+  void merge() {
+    size_t n = image.size();
+    parallelFor(0, n, 16384, [&](size_t lo, size_t hi) {
+      for (auto &h : histograms) {
+        for (size_t i = lo; i < hi; ++i) {
+          image[i] += h[i];
+          h[i] = 0.0f;
+        }
+      }
+    });
+  }
+
+  // Square-root tone curve against the 99.9th percentile of a strided
+  // sample of lit pixels, so a few hot spots do not darken the rest.
+  void toneMap() {
+    std::vector<double> lit;
+    for (size_t i = 0; i < image.size(); i += 7)
+      if (image[i] > 0.0)
+        lit.push_back(image[i]);
+    if (lit.empty())
+      return;
+
+    size_t k = lit.size() * 999 / 1000;
+    std::nth_element(lit.begin(), lit.begin() + k, lit.end());
+    double inv = 1.0 / std::max(lit[k], 1e-12);
+
+    parallelFor(0, image.size(), 16384, [&](size_t lo, size_t hi) {
+      for (size_t i = lo; i < hi; ++i) {
+        float v = (float)std::min(1.0, std::sqrt(image[i] * inv));
+        pixels[i] = palette.at((int)(v * (Palette::size - 1)));
+      }
+    });
+    markAllDirty();
+    uploadDirty(pixels.data());
+  }
+
+  static constexpr int minIter = 16;
+  static constexpr int batch = 32;
+  static constexpr double jumpRate = 0.2;
+  static constexpr double centerX = -0.4;
+  static constexpr float displayInterval = 0.25f;
+  static constexpr uint64_t targetPerPixel = 500;
+
+  // Per-worker histograms only ever hold one merge interval of hits; the
+  // running totals are doubles, which stay exact far past any target.
+  std::vector<std::vector<float>> histograms;
+  std::vector<Chain> chains;
+  std::vector<double> image;
+  std::vector<uint32_t> pixels;
+  Palette palette;
+  Stats stats{};
+  double scale = 1.0;
+  Uint64 lastMerge = 0;
+  bool converged = false;
+  uint64_t generation = 0;
+  bool anti = false;
+  bool metropolis = true;
+};
@@ -0,0 +1,125 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Time budget for one update() call, measured with the performance
+// counter. expired() is cheap enough to call between rows or single queue
+// items, so work is never committed in chunks larger than that.
+class FrameBudget {
+public:
+  explicit FrameBudget(uint32_t maxMs)
+      : start(SDL_GetPerformanceCounter()),
+        limit(SDL_GetPerformanceFrequency() * maxMs / 1000) {}
+
+  bool expired() const { return SDL_GetPerformanceCounter() - start >= limit; }
+
+  double elapsedMs() const {
+    return (SDL_GetPerformanceCounter() - start) * 1000.0 /
+           SDL_GetPerformanceFrequency();
+  }
+
+private:
+  Uint64 start;
+  Uint64 limit;
+};
+
+// Chooses the per-frame update budget from measured vsync headroom. It
+// tracks how long everything except update() and the vsync wait takes,
+// and hands the rest of the refresh period, minus a safety margin, to the
+// fractal.
+class BudgetGovernor {
+public:
+  void setRefreshRate(int hz) {
+    periodMs = hz > 0 ? 1000.0 / hz : 1000.0 / 60.0;
+  }
+
+  void beginFrame() { frameStart = SDL_GetPerformanceCounter(); }
+  void beginUpdate() { updateStart = SDL_GetPerformanceCounter(); }
+  void endUpdate() { updateEnd = SDL_GetPerformanceCounter(); }
+
+  // Call right before SDL_RenderPresent, which blocks on vsync.
+  void beforePresent() {
+    Uint64 now = SDL_GetPerformanceCounter();
+    double overhead = toMs(updateStart - frameStart) + toMs(now - updateEnd);
+    workMs = toMs(now - frameStart);
+    // React to spikes quickly and relax slowly, so a slow frame shrinks the
+    // next budgets right away.
+    double k = overhead > overheadMs ? riseRate : fallRate;
+    overheadMs += (overhead - overheadMs) * k;
+  }
+
+  uint32_t budgetMs() const {
+    double b = periodMs - overheadMs - marginMs;
+    return (uint32_t)std::clamp(b, 1.0, periodMs);
+  }
+
+  // Time from beginFrame() to beforePresent() in the last frame, i.e. the
+  // frame without the vsync wait.
+  double frameMs() const { return workMs; }
+  double refreshMs() const { return periodMs; }
+
+private:
+  static double toMs(Uint64 ticks) {
+    return ticks * 1000.0 / SDL_GetPerformanceFrequency();
+  }
+
+  static constexpr double riseRate = 0.5;
+  static constexpr double fallRate = 0.05;
+  static constexpr double marginMs = 2.0;
+
+  double periodMs = 1000.0 / 60.0;
+  double overheadMs = 2.0;
+  double workMs = 0.0;
+  Uint64 frameStart = 0, updateStart = 0, updateEnd = 0;
+};
+
+// Chooses the render-resolution scale for fractals that redraw every frame
+// from their measured frame times. Their cost is roughly proportional to
+// the pixel count, so the scale moves by the square root of target over
+// measured time. It drops as soon as frames run long but only grows one
+// step at a time, and holds for a few frames after every change, so the
+// fractal is not resized every frame.
+class ResolutionGovernor {
+public:
+  // Feeds one frame's time; returns true if the scale changed.
+  bool frame(double workMs, double periodMs) {
+    smoothMs = frames == 0 ? workMs : smoothMs + (workMs - smoothMs) * rate;
+    if (++frames < settleFrames)
+      return false;
+
+    double target = periodMs * headroom;
+    double want = scaleValue * std::sqrt(target / std::max(smoothMs, 0.1));
+    double next = scaleValue;
+    if (smoothMs > periodMs)
+      next = std::floor(want / step) * step;
+    else if (want >= scaleValue + step)
+      next = scaleValue + step;
+    next = std::clamp(next, minScale, 1.0);
+    if (next == scaleValue)
+      return false;
+
+    scaleValue = next;
+    frames = 0;
+    return true;
+  }
+
+  void reset() {
+    scaleValue = 1.0;
+    frames = 0;
+  }
+
+  float scale() const { return (float)scaleValue; }
+
+private:
+  static constexpr double rate = 0.2;
+  static constexpr double headroom = 0.8;
+  static constexpr double step = 1.0 / 16;
+  static constexpr double minScale = 0.25;
+  static constexpr int settleFrames = 10;
+
+  double scaleValue = 1.0;
+  double smoothMs = 0.0;
+  int frames = 0;
+};
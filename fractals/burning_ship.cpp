@@ -0,0 +1,12 @@
+#include "escape_time.h"
+
+class BurningShip : public EscapeTimeFractal<BurningShipFormula> {
+public:
+  BurningShip(SDL_Renderer *r)
+      : EscapeTimeFractal(r, 256, 100.0f, Palette::Preset::FIRE, 6.0f) {
+    centerX = -0.4;
+    centerY = -0.5;
+  }
+
+  const char *getName() const override { return "Burning Ship"; }
+};
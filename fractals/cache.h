@@ -0,0 +1,164 @@
+#pragma once
+#include "budget.h"
+#include "factory.h"
+#include <SDL2/SDL.h>
+#include <list>
+#include <memory>
+
+// Keeps fractals that are switched away from, with their finished
+// textures, so switching back is instant. Entries are evicted least
+// recently used first once their combined size exceeds the budget.
+//
+// The SDL renderer may only be used from the thread that created it, so
+// pre-warming runs cooperatively on that thread in whatever is left of the
+// frame budget while the visible fractal has nothing to do.
+class FractalCache {
+public:
+  explicit FractalCache(size_t budgetBytes) : budget(budgetBytes) {}
+
+  std::unique_ptr<Fractal> take(FractalType type) {
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+      if (it->type == type) {
+        std::unique_ptr<Fractal> f = std::move(it->fractal);
+        entries.erase(it);
+        return f;
+      }
+    }
+    return {};
+  }
+
+  void put(FractalType type, std::unique_ptr<Fractal> f) {
+    if (!f)
+      return;
+    take(type);
+    entries.push_front({type, std::move(f), false, 0, 0});
+    evict();
+  }
+
+  // Advances the fractals most likely to be picked next: the neighbours of
+  // the current one in key order, skipping types canPrewarm() rules out.
+  // Pre-warming never evicts: a neighbour that does not fit next to the
+  // cached entries is dropped and not tried again at that size.
+  // Returns whether any of them still has work left.
+  bool prewarm(FractalType current, SDL_Renderer *r, int w, int h, float dt,
+               uint32_t maxMs) {
+    if (maxMs == 0)
+      return true;
+
+    FrameBudget frame(maxMs);
+    int count = (int)FractalType::COUNT;
+    int idx = (int)current;
+    FractalType candidates[] = {FractalType((idx + 1) % count),
+                                FractalType((idx + count - 1) % count)};
+
+    bool pending = false;
+    for (FractalType t : candidates) {
+      if (t == current)
+        break;
+      if (!canPrewarm(t) || isOversized(t, w, h))
+        continue;
+      if (frame.expired()) {
+        pending = true;
+        break;
+      }
+
+      Entry *e = find(t);
+      if (!e) {
+        std::unique_ptr<Fractal> f = createFractal(t, r);
+        if (!f)
+          continue;
+        f->resize(w, h);
+        if (bytes() + f->memoryBytes() > budget) {
+          markOversized(t, w, h);
+          continue;
+        }
+        entries.push_back({t, std::move(f), false, w, h});
+        e = &entries.back();
+      }
+
+      if (e->w != w || e->h != h) {
+        e->fractal->resize(w, h);
+        e->w = w;
+        e->h = h;
+        e->complete = false;
+      }
+      if (dropIfOversized(t, w, h))
+        continue;
+
+      if (e->complete || e->fractal->isAnimated())
+        continue;
+
+      double left = maxMs - frame.elapsedMs();
+      e->complete = !e->fractal->update(dt, left > 1.0 ? (uint32_t)left : 1);
+      if (dropIfOversized(t, w, h))
+        continue;
+      pending = pending || !e->complete;
+    }
+
+    return pending;
+  }
+
+  size_t size() const { return entries.size(); }
+
+  template <class F> void forEach(F &&f) const {
+    for (const Entry &e : entries)
+      f(e.type, *e.fractal);
+  }
+
+  size_t bytes() const {
+    size_t total = 0;
+    for (const Entry &e : entries)
+      total += e.fractal->memoryBytes();
+    return total;
+  }
+
+private:
+  struct Entry {
+    FractalType type;
+    std::unique_ptr<Fractal> fractal;
+    bool complete;
+    int w, h;
+  };
+
+  Entry *find(FractalType t) {
+    for (Entry &e : entries)
+      if (e.type == t)
+        return &e;
+    return nullptr;
+  }
+
+  bool isOversized(FractalType t, int w, int h) const {
+    const Size &s = oversized[(int)t];
+    return s.w == w && s.h == h;
+  }
+
+  void markOversized(FractalType t, int w, int h) {
+    oversized[(int)t] = {w, h};
+  }
+
+  bool dropIfOversized(FractalType t, int w, int h) {
+    if (bytes() <= budget)
+      return false;
+    take(t);
+    markOversized(t, w, h);
+    return true;
+  }
+
+  void evict() {
+    size_t total = bytes();
+    while (total > budget && !entries.empty()) {
+      total -= entries.back().fractal->memoryBytes();
+      entries.pop_back();
+    }
+  }
+
+  struct Size {
+    int w, h;
+  };
+
+  // Most recently used first.
+  std::list<Entry> entries;
+  size_t budget;
+  // Per type, the window size at which pre-warming it did not fit.
+  Size oversized[(int)FractalType::COUNT] = {};
+};
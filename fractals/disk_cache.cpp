@@ -0,0 +1,568 @@
+#include "disk_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char cacheMagic[8] = {'F', 'R', 'C', 'A', 'C', 'H', 'E', '1'};
+constexpr uint32_t formatVersion = 2;
+constexpr size_t defaultLimitMb = 1024;
+constexpr float defaultCheckpointSecs = 30.0f;
+
+constexpr char logMagic[8] = {'F', 'R', 'C', 'K', 'P', 'T', '0', '1'};
+constexpr uint32_t logVersion = 2;
+enum : uint32_t { ROW_RECORD = 1, COMMIT_RECORD = 2 };
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t key;
+  uint32_t width, height;
+  uint64_t payloadBytes;
+  uint64_t checksum;
+  uint64_t reserved[2];
+};
+
+static_assert(sizeof(Header) == 64, "cache header layout changed");
+
+struct LogHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t key;
+  uint32_t width, height;
+  uint32_t pixelBytes;
+  uint32_t reserved;
+};
+
+struct Record {
+  uint32_t kind;
+  int32_t y, x0, x1;
+  uint64_t bytes;
+  uint64_t checksum;
+};
+
+static_assert(sizeof(LogHeader) == 40, "checkpoint header layout changed");
+static_assert(sizeof(Record) == 32, "checkpoint record layout changed");
+
+uint64_t recordChecksum(Record r, const iovec *parts, int n) {
+  r.checksum = 0;
+  Checksum64 sum(fnv1a(&r, sizeof(r)));
+  for (int i = 0; i < n; ++i)
+    sum.update(parts[i].iov_base, parts[i].iov_len);
+  return sum.digest();
+}
+
+void syncDirectory(const std::string &file) {
+  std::string dir = fs::path(file).parent_path().string();
+  int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0)
+    return;
+  fsync(fd);
+  ::close(fd);
+}
+
+bool writeAll(int fd, const void *data, size_t len) {
+  const char *p = (const char *)data;
+  while (len > 0) {
+    ssize_t n = ::write(fd, p, len);
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+} // namespace
+
+MappedRender &MappedRender::operator=(MappedRender &&o) noexcept {
+  if (this != &o) {
+    if (base)
+      munmap(base, mapped);
+    base = o.base;
+    mapped = o.mapped;
+    o.base = nullptr;
+    o.mapped = 0;
+  }
+  return *this;
+}
+
+MappedRender::~MappedRender() {
+  if (base)
+    munmap(base, mapped);
+}
+
+const void *MappedRender::data() const {
+  return (const char *)base + sizeof(Header);
+}
+
+size_t MappedRender::size() const {
+  return base ? mapped - sizeof(Header) : 0;
+}
+
+DiskCache &DiskCache::instance() {
+  static DiskCache cache;
+  return cache;
+}
+
+DiskCache::DiskCache() {
+  const char *off = std::getenv("FRACTAL_DISK_CACHE");
+  if (off && std::strcmp(off, "0") == 0)
+    return;
+
+  const char *mb = std::getenv("FRACTAL_CACHE_MB");
+  limitBytes = (mb ? (size_t)std::strtoull(mb, nullptr, 10) : defaultLimitMb)
+               << 20;
+
+  std::string path;
+  if (const char *d = std::getenv("FRACTAL_CACHE_DIR"))
+    path = d;
+  else if (const char *x = std::getenv("XDG_CACHE_HOME"))
+    path = std::string(x) + "/fractals";
+  else if (const char *home = std::getenv("HOME"))
+    path = std::string(home) + "/.cache/fractals";
+
+  const char *secs = std::getenv("FRACTAL_CHECKPOINT_SECS");
+  checkpointInterval =
+      secs ? std::strtof(secs, nullptr) : defaultCheckpointSecs;
+
+  std::error_code ec;
+  if (!path.empty() && limitBytes > 0 && (fs::create_directories(path, ec) ||
+                                          fs::is_directory(path, ec)))
+    dir = path;
+}
+
+uint64_t DiskCache::key(const void *params, size_t len) const {
+  uint64_t h = fnv1a(FRACTAL_VERSION, std::strlen(FRACTAL_VERSION));
+  h = fnv1a(&formatVersion, sizeof(formatVersion), h);
+  return fnv1a(params, len, h);
+}
+
+std::string DiskCache::pathFor(uint64_t key, const char *ext) const {
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx%s", (unsigned long long)key, ext);
+  return dir + name;
+}
+
+DiskCache::~DiskCache() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_one();
+  if (writer.joinable())
+    writer.join();
+}
+
+void DiskCache::store(uint64_t key, uint32_t w, uint32_t h,
+                      std::vector<char> payload) {
+  if (!enabled() || payload.size() + sizeof(Header) > limitBytes)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    jobs.push_back({key, w, h, std::move(payload)});
+    if (!writer.joinable())
+      writer = std::thread(&DiskCache::writerLoop, this);
+  }
+  wake.notify_one();
+}
+
+void DiskCache::scheduleTrim() {
+  if (!enabled())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    trimPending = true;
+    if (!writer.joinable())
+      writer = std::thread(&DiskCache::writerLoop, this);
+  }
+  wake.notify_one();
+}
+
+// Pending stores are finished before the process exits.
+void DiskCache::writerLoop() {
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    wake.wait(lock,
+              [&] { return stopping || trimPending || !jobs.empty(); });
+    if (jobs.empty() && !trimPending)
+      return;
+
+    if (jobs.empty()) {
+      trimPending = false;
+      lock.unlock();
+      trim();
+    } else {
+      Job job = std::move(jobs.front());
+      jobs.pop_front();
+      lock.unlock();
+      if (write(job))
+        trim();
+    }
+    lock.lock();
+  }
+}
+
+bool DiskCache::write(const Job &job) {
+  const void *payload = job.payload.data();
+  size_t bytes = job.payload.size();
+
+  Header hdr{};
+  std::memcpy(hdr.magic, cacheMagic, sizeof(cacheMagic));
+  hdr.version = formatVersion;
+  hdr.headerSize = sizeof(Header);
+  hdr.key = job.key;
+  hdr.width = job.w;
+  hdr.height = job.h;
+  hdr.payloadBytes = bytes;
+  hdr.checksum = checksum64(payload, bytes);
+
+  std::string path = pathFor(job.key);
+  std::string tmp = path + ".tmp" + std::to_string(getpid());
+
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+
+  bool ok = writeAll(fd, &hdr, sizeof(hdr)) && writeAll(fd, payload, bytes);
+  ok = (::close(fd) == 0) && ok;
+
+  if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+MappedRender DiskCache::load(uint64_t key, uint32_t w, uint32_t h,
+                             size_t bytes) {
+  MappedRender m;
+  if (!enabled())
+    return m;
+
+  std::string path = pathFor(key);
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return m;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size != sizeof(Header) + bytes) {
+    ::close(fd);
+    std::remove(path.c_str());
+    return m;
+  }
+
+  void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED)
+    return m;
+
+  m.base = p;
+  m.mapped = (size_t)st.st_size;
+  madvise(p, m.mapped, MADV_SEQUENTIAL);
+
+  const Header *hdr = (const Header *)p;
+  bool valid = std::memcmp(hdr->magic, cacheMagic, sizeof(cacheMagic)) == 0 &&
+               hdr->version == formatVersion &&
+               hdr->headerSize == sizeof(Header) && hdr->key == key &&
+               hdr->width == w && hdr->height == h &&
+               hdr->payloadBytes == bytes &&
+               hdr->checksum == checksum64(m.data(), bytes);
+
+  if (!valid) {
+    m = MappedRender();
+    std::remove(path.c_str());
+    return m;
+  }
+
+  std::error_code ec;
+  fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+  return m;
+}
+
+void DiskCache::holdLog(const std::string &path) {
+  std::lock_guard<std::mutex> lock(mutex);
+  liveLogs.insert(fs::path(path).filename().string());
+}
+
+void DiskCache::releaseLog(const std::string &path) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = liveLogs.find(fs::path(path).filename().string());
+  if (it != liveLogs.end())
+    liveLogs.erase(it);
+}
+
+void DiskCache::trim() {
+  struct Item {
+    fs::path path;
+    fs::file_time_type time;
+    uintmax_t size;
+  };
+
+  std::vector<Item> items;
+  uintmax_t total = 0;
+  std::error_code ec;
+
+  // Temporary files of this process are still being written, and so are
+  // the checkpoint logs it holds.
+  std::string ownTmp = ".tmp" + std::to_string(getpid());
+  std::multiset<std::string> live;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    live = liveLogs;
+  }
+  for (const auto &e : fs::directory_iterator(dir, ec)) {
+    std::string ext = e.path().extension().string();
+    bool tmp = ext.compare(0, 4, ".tmp") == 0;
+    if ((ext != ".frc" && ext != ".ckp" && !tmp) || ext == ownTmp ||
+        live.count(e.path().filename().string()))
+      continue;
+    uintmax_t size = e.file_size(ec);
+    if (ec)
+      continue;
+    items.push_back({e.path(), e.last_write_time(ec), size});
+    total += size;
+  }
+
+  if (total <= limitBytes)
+    return;
+
+  std::sort(items.begin(), items.end(),
+            [](const Item &a, const Item &b) { return a.time < b.time; });
+
+  for (const Item &it : items) {
+    if (total <= limitBytes)
+      break;
+    if (fs::remove(it.path, ec))
+      total -= it.size;
+  }
+}
+
+CheckpointLog::~CheckpointLog() {
+  close();
+  setPath({});
+}
+
+void CheckpointLog::setPath(const std::string &file) {
+  DiskCache &cache = DiskCache::instance();
+  if (!path.empty())
+    cache.releaseLog(path);
+  path = file;
+  if (!path.empty())
+    cache.holdLog(path);
+}
+
+void CheckpointLog::close() {
+  if (fd >= 0)
+    ::close(fd);
+  if (replacing)
+    std::remove(tmp.c_str());
+  fd = -1;
+  replacing = false;
+  failed = false;
+}
+
+void CheckpointLog::discard() {
+  close();
+  if (!path.empty())
+    std::remove(path.c_str());
+  setPath({});
+  written = committed = 0;
+}
+
+bool CheckpointLog::resume(uint64_t key, uint32_t w, uint32_t h,
+                           uint32_t pixelBytes, void *state,
+                           size_t stateBytes, const RowFn &row) {
+  DiskCache &cache = DiskCache::instance();
+  if (!cache.enabled() || cache.checkpointSecs() <= 0.0f)
+    return false;
+
+  std::string file = cache.checkpointPath(key);
+  int in = ::open(file.c_str(), O_RDONLY);
+  if (in < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(in, &st) != 0 || (size_t)st.st_size < sizeof(LogHeader)) {
+    ::close(in);
+    return false;
+  }
+
+  size_t size = (size_t)st.st_size;
+  void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, in, 0);
+  ::close(in);
+  if (p == MAP_FAILED)
+    return false;
+  madvise(p, size, MADV_SEQUENTIAL);
+
+  const char *base = (const char *)p;
+  const LogHeader *hdr = (const LogHeader *)p;
+  bool valid = std::memcmp(hdr->magic, logMagic, sizeof(logMagic)) == 0 &&
+               hdr->version == logVersion &&
+               hdr->headerSize == sizeof(LogHeader) && hdr->key == key &&
+               hdr->width == w && hdr->height == h &&
+               hdr->pixelBytes == pixelBytes;
+
+  // Finds the end of the last commit whose records are all intact.
+  size_t end = 0;
+  const char *lastState = nullptr;
+  for (size_t off = sizeof(LogHeader); valid && off + sizeof(Record) <= size;) {
+    Record r;
+    std::memcpy(&r, base + off, sizeof(r));
+    const char *payload = base + off + sizeof(r);
+    if (r.bytes > size - off - sizeof(r))
+      break;
+    if (r.kind == ROW_RECORD) {
+      if (r.y < 0 || (uint32_t)r.y >= h || r.x0 < 0 || r.x0 >= r.x1 ||
+          (uint32_t)r.x1 > w ||
+          r.bytes != (uint64_t)(r.x1 - r.x0) * pixelBytes)
+        break;
+    } else if (r.kind != COMMIT_RECORD || r.bytes != stateBytes) {
+      break;
+    }
+    iovec part = {(void *)payload, (size_t)r.bytes};
+    if (recordChecksum(r, &part, 1) != r.checksum)
+      break;
+    off += sizeof(r) + r.bytes;
+    if (r.kind == COMMIT_RECORD) {
+      end = off;
+      lastState = payload;
+    }
+  }
+
+  for (size_t off = sizeof(LogHeader); off < end;) {
+    Record r;
+    std::memcpy(&r, base + off, sizeof(r));
+    if (r.kind == ROW_RECORD)
+      row(r.y, r.x0, r.x1, base + off + sizeof(r));
+    off += sizeof(r) + r.bytes;
+  }
+  if (end)
+    std::memcpy(state, lastState, stateBytes);
+  munmap(p, size);
+
+  if (!end) {
+    std::remove(file.c_str());
+    return false;
+  }
+
+  // Later checkpoints append after the last commit; if the file cannot be
+  // reopened the next one starts a new log.
+  close();
+  setPath(file);
+  written = committed = end;
+  fd = ::open(path.c_str(), O_WRONLY);
+  if (fd >= 0 && (ftruncate(fd, (off_t)end) != 0 ||
+                  lseek(fd, 0, SEEK_END) != (off_t)end)) {
+    ::close(fd);
+    fd = -1;
+  }
+  return true;
+}
+
+bool CheckpointLog::create(uint64_t key, uint32_t w, uint32_t h,
+                           uint32_t pixelBytes) {
+  close();
+  DiskCache &cache = DiskCache::instance();
+  if (!cache.enabled())
+    return false;
+
+  std::string file = cache.checkpointPath(key);
+  if (!path.empty() && path != file)
+    std::remove(path.c_str());
+  setPath(file);
+  tmp = path + ".tmp" + std::to_string(getpid());
+
+  fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+  replacing = true;
+
+  LogHeader hdr{};
+  std::memcpy(hdr.magic, logMagic, sizeof(logMagic));
+  hdr.version = logVersion;
+  hdr.headerSize = sizeof(LogHeader);
+  hdr.key = key;
+  hdr.width = w;
+  hdr.height = h;
+  hdr.pixelBytes = pixelBytes;
+  written = committed = sizeof(hdr);
+  if (!writeAll(fd, &hdr, sizeof(hdr))) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool CheckpointLog::append(uint32_t kind, int y, int x0, int x1,
+                           const iovec *parts, int n) {
+  if (fd < 0 || failed)
+    return false;
+
+  Record r{kind, y, x0, x1, 0, 0};
+  for (int i = 0; i < n; ++i)
+    r.bytes += parts[i].iov_len;
+  r.checksum = recordChecksum(r, parts, n);
+
+  failed = !writeAll(fd, &r, sizeof(r));
+  for (int i = 0; i < n && !failed; ++i)
+    failed = !writeAll(fd, parts[i].iov_base, parts[i].iov_len);
+  written += sizeof(r) + r.bytes;
+  return !failed;
+}
+
+bool CheckpointLog::appendRow(int y, int x0, int x1, const iovec *parts,
+                              int n) {
+  return append(ROW_RECORD, y, x0, x1, parts, n);
+}
+
+bool CheckpointLog::commit(const void *state, size_t bytes) {
+  iovec part = {const_cast<void *>(state), bytes};
+  bool ok = append(COMMIT_RECORD, 0, 0, 0, &part, 1) && fdatasync(fd) == 0;
+
+  // The data is synced before the rename, so a failed directory sync only
+  // risks the old log coming back, which is still a valid checkpoint.
+  bool compacted = false;
+  if (ok && replacing) {
+    ok = std::rename(tmp.c_str(), path.c_str()) == 0;
+    replacing = !ok;
+    compacted = ok;
+    if (compacted)
+      syncDirectory(path);
+  }
+
+  if (!ok) {
+    rollback();
+    return false;
+  }
+
+  committed = written;
+  if (compacted)
+    DiskCache::instance().scheduleTrim();
+  return true;
+}
+
+void CheckpointLog::rollback() {
+  if (replacing || fd < 0 || ftruncate(fd, (off_t)committed) != 0 ||
+      lseek(fd, 0, SEEK_END) != (off_t)committed) {
+    close();
+    committed = 0;
+  }
+  failed = false;
+  written = committed;
+}
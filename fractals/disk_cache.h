@@ -0,0 +1,222 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <sys/uio.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef FRACTAL_VERSION
+#define FRACTAL_VERSION "dev"
+#endif
+
+// 64-bit FNV-1a, used for cache keys and short records.
+inline uint64_t fnv1a(const void *data, size_t len,
+                      uint64_t h = 0xcbf29ce484222325ull) {
+  const unsigned char *p = (const unsigned char *)data;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= p[i];
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+// Payload checksum. FNV-style steps on 64-bit words in four independent
+// lanes, so a multi-megabyte buffer hashes at memory speed; the tail goes
+// through fnv1a. Data may arrive in pieces of any size.
+class Checksum64 {
+public:
+  explicit Checksum64(uint64_t seed = 0xcbf29ce484222325ull)
+      : lane{seed, seed ^ 1, seed ^ 2, seed ^ 3} {}
+
+  void update(const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    total += len;
+    if (fill > 0) {
+      size_t take = std::min(sizeof(block) - fill, len);
+      std::memcpy(block + fill, p, take);
+      fill += take;
+      p += take;
+      len -= take;
+      if (fill < sizeof(block))
+        return;
+      mix(block);
+      fill = 0;
+    }
+    for (; len >= sizeof(block); p += sizeof(block), len -= sizeof(block))
+      mix(p);
+    std::memcpy(block, p, len);
+    fill = len;
+  }
+
+  uint64_t digest() const {
+    return fnv1a(block, fill, fnv1a(lane, sizeof(lane), total));
+  }
+
+private:
+  void mix(const unsigned char *p) {
+    for (int k = 0; k < 4; ++k) {
+      uint64_t w;
+      std::memcpy(&w, p + k * 8, 8);
+      lane[k] = (lane[k] ^ w) * 0x100000001b3ull;
+      lane[k] ^= lane[k] >> 29;
+    }
+  }
+
+  uint64_t lane[4];
+  uint64_t total = 0;
+  unsigned char block[32];
+  size_t fill = 0;
+};
+
+inline uint64_t checksum64(const void *data, size_t len,
+                           uint64_t seed = 0xcbf29ce484222325ull) {
+  Checksum64 sum(seed);
+  sum.update(data, len);
+  return sum.digest();
+}
+
+// Read-only memory mapping of a validated cache entry.
+class MappedRender {
+public:
+  MappedRender() = default;
+  MappedRender(const MappedRender &) = delete;
+  MappedRender &operator=(const MappedRender &) = delete;
+  MappedRender(MappedRender &&o) noexcept { *this = std::move(o); }
+  MappedRender &operator=(MappedRender &&o) noexcept;
+  ~MappedRender();
+
+  explicit operator bool() const { return base != nullptr; }
+  const void *data() const;
+  size_t size() const;
+
+private:
+  friend class DiskCache;
+  void *base = nullptr;
+  size_t mapped = 0;
+};
+
+// Directory of finished renders stored as a fixed header followed by the
+// raw payload, so a hit is just mmap, header and checksum validation and a
+// memcpy. Stores are written, and the directory trimmed, on a writer
+// thread, so finishing a render does not stall the frame. Files are keyed
+// by a hash the caller builds from everything that affects the image; the
+// build version is mixed into every key. The directory, checkpoint logs
+// and leftover temporary files included, is trimmed oldest-first to a
+// size limit after each store and each checkpoint compaction. Checkpoint
+// logs that a CheckpointLog in this process has open are never trimmed.
+//
+// FRACTAL_CACHE_DIR overrides the location (default
+// $XDG_CACHE_HOME/fractals or ~/.cache/fractals), FRACTAL_CACHE_MB the size
+// limit, and FRACTAL_DISK_CACHE=0 disables the cache.
+// FRACTAL_CHECKPOINT_SECS sets how often unfinished renders write a
+// CheckpointLog into the same directory; 0 turns checkpoints off.
+class DiskCache {
+public:
+  static DiskCache &instance();
+
+  bool enabled() const { return !dir.empty(); }
+  float checkpointSecs() const {
+    return enabled() ? checkpointInterval : 0.0f;
+  }
+  std::string checkpointPath(uint64_t key) const {
+    return pathFor(key, ".ckp");
+  }
+
+  uint64_t key(const void *params, size_t len) const;
+
+  void store(uint64_t key, uint32_t w, uint32_t h,
+             std::vector<char> payload);
+  MappedRender load(uint64_t key, uint32_t w, uint32_t h, size_t bytes);
+  // Has the writer thread trim the directory.
+  void scheduleTrim();
+
+private:
+  friend class CheckpointLog;
+
+  struct Job {
+    uint64_t key;
+    uint32_t w, h;
+    std::vector<char> payload;
+  };
+
+  DiskCache();
+  ~DiskCache();
+  std::string pathFor(uint64_t key, const char *ext = ".frc") const;
+  bool write(const Job &job);
+  void writerLoop();
+  void trim();
+  // Keeps a checkpoint log out of trim() while a CheckpointLog refers to it.
+  void holdLog(const std::string &path);
+  void releaseLog(const std::string &path);
+
+  std::string dir;
+  size_t limitBytes = 0;
+  float checkpointInterval = 0.0f;
+
+  std::thread writer;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<Job> jobs;
+  // File names of the held checkpoint logs.
+  std::multiset<std::string> liveLogs;
+  bool trimPending = false;
+  bool stopping = false;
+};
+
+// Append-only checkpoint of an unfinished render, so a long render survives
+// a restart. The file is a header followed by row records, each a span of
+// one row's per-pixel state, and commit records holding the caller's
+// scalar state. A checkpoint is the rows that changed since the previous
+// one followed by a commit, which syncs the file, so a committed
+// checkpoint survives a crash. resume() replays the rows up to the last
+// intact commit, so a write cut short is simply dropped. create() starts
+// a compacted log in a temporary file that replaces the old one, synced
+// along with its directory, at its first commit. Records are 8-byte
+// aligned when the payloads are.
+class CheckpointLog {
+public:
+  using RowFn = std::function<void(int y, int x0, int x1, const char *data)>;
+
+  CheckpointLog() = default;
+  CheckpointLog(const CheckpointLog &) = delete;
+  CheckpointLog &operator=(const CheckpointLog &) = delete;
+  ~CheckpointLog();
+
+  // Restores the last committed state of the log for key into state and
+  // row(), then keeps the log open for appending. pixelBytes is the
+  // payload size of one pixel in a row record.
+  bool resume(uint64_t key, uint32_t w, uint32_t h, uint32_t pixelBytes,
+              void *state, size_t stateBytes, const RowFn &row);
+  bool create(uint64_t key, uint32_t w, uint32_t h, uint32_t pixelBytes);
+  bool appendRow(int y, int x0, int x1, const iovec *parts, int n);
+  // Makes the rows appended since the last commit durable; on failure
+  // they are rolled back.
+  bool commit(const void *state, size_t bytes);
+  // Drops the rows appended since the last commit.
+  void rollback();
+  // Closes the log and deletes its file.
+  void discard();
+
+  size_t size() const { return committed; }
+
+private:
+  void close();
+  void setPath(const std::string &file);
+  bool append(uint32_t kind, int y, int x0, int x1, const iovec *parts,
+              int n);
+
+  int fd = -1;
+  bool replacing = false;
+  bool failed = false;
+  size_t written = 0, committed = 0;
+  std::string path, tmp;
+};
@@ -0,0 +1,967 @@
+#pragma once
+#include "budget.h"
+#include "disk_cache.h"
+#include "fractal.h"
+#include "kernels.h"
+#include "palette.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Anti-aliasing pass for escape-time images. After the image is rendered
+// at one sample per pixel, only pixels whose iteration count differs from
+// one of their eight neighbours are resampled with a jittered
+// level+1 x level+1 grid. Sample values are kept so recoloring does not
+// need to resample.
+class AdaptiveSampler {
+public:
+  static constexpr int maxLevel = 3;
+
+  struct Refined {
+    int idx;
+    int offset;
+  };
+
+  int getLevel() const { return level; }
+
+  void setLevel(int l) {
+    level = l < 0 ? 0 : (l > maxLevel ? maxLevel : l);
+    restart();
+  }
+
+  void cycleLevel() { setLevel((level + 1) % (maxLevel + 1)); }
+
+  void restart() {
+    row = 0;
+    visited = 0;
+    refined.clear();
+    values.clear();
+    pending = level > 0;
+  }
+
+  bool finished(int h) const { return !pending || row >= h; }
+
+  int samplesPerPixel() const { return (level + 1) * (level + 1); }
+  const std::vector<Refined> &getRefined() const { return refined; }
+  const std::vector<float> &getValues() const { return values; }
+
+  // Refines rows until the budget runs out. sample(fx, fy) returns the
+  // smooth value at a fractional pixel position. Returns true if any
+  // samples were added.
+  template <class Sample>
+  bool refine(const std::vector<int> &iters, int w, int h,
+              const FrameBudget &budget, Sample &&sample) {
+    int n = level + 1;
+    int spp = n * n;
+    size_t before = refined.size();
+
+    while (pending && row < h) {
+      if (budget.expired())
+        break;
+
+      size_t first = refined.size();
+      for (int x = 0; x < w; ++x) {
+        if (isEdge(iters, w, h, x, row))
+          refined.push_back({row * w + x, (int)(refined.size() * spp)});
+      }
+      visited += w;
+      values.resize(refined.size() * spp);
+
+      parallelFor(first, refined.size(), 16, [&](size_t lo, size_t hi) {
+        for (size_t k = lo; k < hi; ++k) {
+          int idx = refined[k].idx;
+          int px = idx % w, py = idx / w;
+          float *out = values.data() + refined[k].offset;
+          for (int sy = 0; sy < n; ++sy) {
+            for (int sx = 0; sx < n; ++sx) {
+              uint32_t seed = (uint32_t)idx * 16u + (uint32_t)(sy * n + sx);
+              double ox = (sx + unitHash(seed * 2u)) / n - 0.5;
+              double oy = (sy + unitHash(seed * 2u + 1u)) / n - 0.5;
+              *out++ = sample(px + ox, py + oy);
+            }
+          }
+        }
+      });
+      row++;
+    }
+
+    if (row >= h)
+      pending = false;
+    return refined.size() != before;
+  }
+
+  size_t memoryBytes() const {
+    return refined.capacity() * sizeof(Refined) +
+           values.capacity() * sizeof(float);
+  }
+
+  std::string getStatus() const {
+    if (level == 0)
+      return "AA: off";
+    char buf[96];
+    double frac = visited ? 100.0 * refined.size() / visited : 0.0;
+    snprintf(buf, sizeof(buf), "AA: %dx%d | Refined: %.1f%% (%zu samples)",
+             level + 1, level + 1, frac, values.size());
+    return buf;
+  }
+
+private:
+  static bool isEdge(const std::vector<int> &iters, int w, int h, int x,
+                     int y) {
+    int v = iters[y * w + x];
+    for (int dy = -1; dy <= 1; ++dy) {
+      int ny = y + dy;
+      if (ny < 0 || ny >= h)
+        continue;
+      for (int dx = -1; dx <= 1; ++dx) {
+        int nx = x + dx;
+        if (nx < 0 || nx >= w)
+          continue;
+        if (iters[ny * w + nx] != v)
+          return true;
+      }
+    }
+    return false;
+  }
+
+  static double unitHash(uint32_t v) {
+    v ^= v >> 16;
+    v *= 0x7feb352dU;
+    v ^= v >> 15;
+    v *= 0x846ca68bU;
+    v ^= v >> 16;
+    return (v >> 8) * (1.0 / 16777216.0);
+  }
+
+  int level = 0;
+  int row = 0;
+  bool pending = false;
+  size_t visited = 0;
+  std::vector<Refined> refined;
+  std::vector<float> values;
+};
+
+// Progressive escape-time renderer for any formula policy in kernels.h.
+// Every pass advances all still-running orbits by one step. Finished
+// pixels keep their normalized smooth value, and a separate parallel pass
+// maps those values through the palette LUT, so recoloring and palette
+// cycling never re-iterate. Each formula instantiates its own copy of the
+// row kernel, so the inner loop has no per-pixel dispatch.
+//
+// Unfinished renders are checkpointed to a CheckpointLog every
+// FRACTAL_CHECKPOINT_SECS and resumed when the fractal is resized to a size
+// it has one for; resets that follow, such as from pan(), start clean.
+// The log is written on a background thread straight from the buffers;
+// the passes pause until it is done, while frames keep being drawn.
+template <class Formula> class EscapeTimeFractal : public FractalFB {
+public:
+  EscapeTimeFractal(SDL_Renderer *r, int maxIter, float passRate,
+                    Palette::Preset preset, float density)
+      : FractalFB(r), maxIter(maxIter), palette(preset), density(density),
+        passRate(passRate) {}
+
+  ~EscapeTimeFractal() override { finishCheckpoint(true); }
+
+  void resize(int w, int h) override {
+    resumable = true;
+    FractalFB::resize(w, h);
+    resumable = false;
+  }
+
+  void reset() override {
+    finishCheckpoint(true);
+    size_t n = (size_t)width * height;
+    zx.assign(n, 0.0);
+    zy.assign(n, 0.0);
+    iters.assign(n, 0);
+    smooth.assign(n, -1.0f);
+    pixels.assign(n, Palette::rgba(0, 0, 0));
+
+    columnCx.resize(width);
+    for (int x = 0; x < width; ++x)
+      columnCx[x] = juliaSet ? seedX : planeX(x);
+
+    if (juliaSet) {
+      parallelFor(0, height, 16, [&](size_t y0, size_t y1) {
+        for (size_t y = y0; y < y1; ++y) {
+          for (int x = 0; x < width; ++x) {
+            size_t i = y * width + x;
+            zx[i] = planeX(x);
+            zy[i] = planeY((int)y);
+          }
+        }
+      });
+    }
+
+    pending.assign(height, DirtySpan{width, 0});
+    pendingRows = 0;
+
+    iter = 0;
+    passRow = 0;
+    passAcc = 0.0f;
+    alive = (long)n;
+    sampler.restart();
+    dataDirty = true;
+    clear();
+
+    fromDisk = persisted = loadFromDisk();
+    resumed = false;
+    checkpointFresh = true;
+    checkpointAcc = 0.0f;
+    if (!fromDisk && resumable)
+      resumed = resumeCheckpoint();
+    resumable = false;
+  }
+
+  bool update(float dt, uint32_t maxMs) override {
+    if (cycling) {
+      paletteOffset += dt * cycleSpeed;
+      colorDirty = true;
+    }
+
+    bool iterating = alive > 0 && iter < maxIter;
+    if (!iterating && pendingRows == 0 && sampler.finished(height) &&
+        !dataDirty && !passDirty && !colorDirty)
+      return false;
+
+    FrameBudget budget(maxMs);
+
+    if (checkpointWriter.joinable() && !checkpointBusy)
+      finishCheckpoint(false);
+    bool writing = checkpointWriter.joinable();
+
+    if (pendingRows > 0)
+      resolvePending(&budget);
+
+    if (!writing)
+      passAcc += dt * passRate;
+
+    while (!writing && passAcc >= 1.0f && alive > 0 && iter < maxIter) {
+      if (!advancePass(budget))
+        break;
+      iter++;
+      passAcc -= 1.0f;
+    }
+
+    iterating = alive > 0 && iter < maxIter;
+    if (!iterating && pendingRows == 0 && !persisted) {
+      saveToDisk();
+      checkpoint.discard();
+      persisted = true;
+    }
+
+    float interval = DiskCache::instance().checkpointSecs();
+    if (iterating && !writing && interval > 0.0f && pendingRows == 0 &&
+        (checkpointAcc += dt) >= interval) {
+      startCheckpoint();
+      checkpointAcc = 0.0f;
+    }
+
+    if (!iterating && pendingRows == 0) {
+      auto sample = [&](double fx, double fy) { return sampleAt(fx, fy); };
+      if (sampler.refine(iters, width, height, budget, sample))
+        dataDirty = true;
+    }
+
+    if (dataDirty || passDirty || colorDirty)
+      colorize();
+
+    return iterating || pendingRows > 0 || !sampler.finished(height) ||
+           cycling;
+  }
+
+  // Moves the view so the image follows a drag of (dx, dy) pixels. All
+  // per-pixel buffers are shifted in place and only the exposed strips
+  // start over: they are marked pending (iteration -1, which the passes
+  // skip) and resolvePending() brings them up to the running pass count a
+  // few rows per frame, so the shifted image shows at once.
+  bool pan(int dx, int dy) override {
+    if (zx.empty() || (dx == 0 && dy == 0))
+      return true;
+
+    finishCheckpoint(true);
+    centerX -= dx * 4.0 / width;
+    centerY -= dy * 4.0 / width;
+    persisted = fromDisk = resumed = false;
+    checkpointFresh = true;
+    if (std::abs(dx) >= width || std::abs(dy) >= height) {
+      reset();
+      return true;
+    }
+
+    for (int x = 0; x < width; ++x)
+      columnCx[x] = juliaSet ? seedX : planeX(x);
+
+    ThreadPool::instance().run(5, [&](int t) {
+      switch (t) {
+      case 0:
+        shiftBuffer(zx, dx, dy);
+        break;
+      case 1:
+        shiftBuffer(zy, dx, dy);
+        break;
+      case 2:
+        shiftBuffer(iters, dx, dy);
+        break;
+      case 3:
+        shiftBuffer(smooth, dx, dy);
+        break;
+      default:
+        shiftBuffer(pixels, dx, dy);
+        break;
+      }
+    });
+
+    std::vector<DirtySpan> moved(height, DirtySpan{width, 0});
+    for (int y = std::max(0, -dy); y < std::min(height, height - dy); ++y) {
+      DirtySpan s = pending[y];
+      s.x0 = std::max(0, s.x0 + dx);
+      s.x1 = std::min(width, s.x1 + dx);
+      moved[y + dy] = s;
+    }
+    pending.swap(moved);
+
+    if (passRow > 0)
+      passRow = std::clamp(passRow + dy, 0, height);
+
+    pendingRows = 0;
+    for (int y = 0; y < height; ++y) {
+      if (y < dy || y >= height + dy)
+        markPending(y, 0, width);
+      else if (dx > 0)
+        markPending(y, 0, dx);
+      else if (dx < 0)
+        markPending(y, width + dx, width);
+      pendingRows += pending[y].x0 < pending[y].x1;
+    }
+
+    alive = (long)std::count(iters.begin(), iters.end(), 0);
+    sampler.restart();
+    markAllDirty();
+    uploadDirty(pixels.data());
+    return true;
+  }
+
+  bool handleKey(SDL_Keycode key) override {
+    switch (key) {
+    case SDLK_a:
+      sampler.cycleLevel();
+      dataDirty = true;
+      return true;
+    case SDLK_c:
+      palette.next();
+      colorDirty = true;
+      return true;
+    case SDLK_p:
+      cycling = !cycling;
+      return true;
+    case SDLK_e:
+      equalize = !equalize;
+      dataDirty = true;
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  size_t memoryBytes() const override {
+    return FractalFB::memoryBytes() +
+           (zx.capacity() + zy.capacity()) * sizeof(double) +
+           iters.capacity() * sizeof(int) +
+           (smooth.capacity() + eqLut.capacity()) * sizeof(float) +
+           (pixels.capacity() + scratch.capacity()) * sizeof(uint32_t) +
+           sampler.memoryBytes();
+  }
+
+  FractalMetrics metrics() const override {
+    FractalMetrics m = counters;
+    m.queued = iter < maxIter ? (size_t)alive : 0;
+    return m;
+  }
+
+  // Same values as the progressive render reaches for these pixels, before
+  // adaptive anti-aliasing.
+  bool computeTile(int viewW, int viewH, int x0, int y0, int w, int h,
+                   float *out) const override {
+    for (int y = y0; y < y0 + h; ++y) {
+      for (int x = x0; x < x0 + w; ++x) {
+        int n;
+        double px = planeX(x, viewW), py = planeY(y, viewW, viewH);
+        *out++ = juliaSet
+                     ? escapeSmooth<Formula>(px, py, seedX, seedY, maxIter, n)
+                     : escapeSmooth<Formula>(0.0, 0.0, px, py, maxIter, n);
+      }
+    }
+    return true;
+  }
+
+  void colorTile(const float *values, size_t n,
+                 uint32_t *out) const override {
+    for (size_t i = 0; i < n; ++i)
+      out[i] = colorOf(values[i], 0);
+  }
+
+  std::string getStatus() const override {
+    char buf[96];
+    snprintf(buf, sizeof(buf), "Iter: %d/%d%s | Palette: %s%s%s | ", iter,
+             maxIter,
+             fromDisk                       ? " (disk)"
+             : checkpointWriter.joinable() ? " (checkpoint)"
+             : resumed                     ? " (resumed)"
+                                           : "",
+             palette.getName(),
+             cycling ? " (cycling)" : "", equalize ? " (eq)" : "");
+    return buf + sampler.getStatus();
+  }
+
+protected:
+  // Mandelbrot iterates from z = 0 with c at the pixel. With juliaSet set,
+  // z starts at the pixel and c is (seedX, seedY). The view is four units
+  // wide around (centerX, centerY).
+  bool juliaSet = false;
+  double seedX = 0.0, seedY = 0.0;
+  double centerX = 0.0, centerY = 0.0;
+
+  const int maxIter;
+  Palette palette;
+  float density;
+
+  double planeX(double x) const { return planeX(x, width); }
+  double planeY(double y) const { return planeY(y, width, height); }
+  double planeX(double x, int w) const {
+    return centerX + (x - w / 2) * 4.0 / w;
+  }
+  double planeY(double y, int w, int h) const {
+    return centerY + (y - h / 2) * 4.0 / w;
+  }
+
+  // The view scales with the width and is centered vertically, so a height
+  // change only shifts rows: surviving rows are moved in place and the
+  // exposed rows are marked pending, for resolvePending() to fill under the
+  // frame budget as after a pan. A width change rescales everything; it
+  // restarts the render but keeps showing the old image, scaled, until
+  // each pixel is resolved again.
+  bool reproject(int oldW, int oldH) override {
+    if (zx.empty())
+      return false;
+
+    finishCheckpoint(true);
+    if (oldW != width) {
+      scratch.swap(pixels);
+      reset();
+      for (int y = 0; y < height; ++y) {
+        int sy = std::min(oldH - 1, (int)((long)y * oldH / height));
+        for (int x = 0; x < width; ++x) {
+          int sx = std::min(oldW - 1, (int)((long)x * oldW / width));
+          pixels[(size_t)y * width + x] = scratch[(size_t)sy * oldW + sx];
+        }
+      }
+      colorize();
+      return true;
+    }
+
+    int dy = height / 2 - oldH / 2;
+    int keep0 = std::max(0, -dy);
+    int keep1 = std::min(oldH, height - dy);
+
+    if (passRow > 0)
+      passRow = std::clamp(passRow + dy, 0, height);
+
+    std::vector<DirtySpan> moved(height, DirtySpan{width, 0});
+    pendingRows = 0;
+    for (int y = keep0; y < keep1; ++y) {
+      moved[y + dy] = pending[y];
+      pendingRows += pending[y].x0 < pending[y].x1;
+    }
+    pending.swap(moved);
+
+    shiftRows(zx, oldH, keep0, keep1, dy);
+    shiftRows(zy, oldH, keep0, keep1, dy);
+    shiftRows(iters, oldH, keep0, keep1, dy);
+    shiftRows(smooth, oldH, keep0, keep1, dy);
+    shiftRows(pixels, oldH, keep0, keep1, dy);
+
+    for (int y = 0; y < height; ++y) {
+      if (y < keep0 + dy || y >= keep1 + dy) {
+        markPending(y, 0, width);
+        pendingRows++;
+      }
+    }
+
+    alive = (long)std::count(iters.begin(), iters.end(), 0);
+    persisted = fromDisk = resumed = false;
+    checkpointFresh = true;
+    sampler.restart();
+    dataDirty = true;
+    colorize();
+    return true;
+  }
+
+private:
+  // Moves old rows [keep0, keep1) to keep0 + dy, growing or shrinking the
+  // buffer around the move so it reuses the existing allocation.
+  template <class T>
+  void shiftRows(std::vector<T> &v, int oldH, int keep0, int keep1, int dy) {
+    size_t n = (size_t)width * height;
+    if ((size_t)height > (size_t)oldH)
+      v.resize(n);
+    if (keep1 > keep0 && dy != 0)
+      std::memmove(v.data() + (size_t)(keep0 + dy) * width,
+                   v.data() + (size_t)keep0 * width,
+                   (size_t)(keep1 - keep0) * width * sizeof(T));
+    v.resize(n);
+  }
+
+  // Brings a fresh pixel up to the current pass count, including the step
+  // of the running pass for rows above the pass cursor, so it is in the
+  // same state as if it had been rendered from the start.
+  void computePixel(int x, int y) {
+    size_t i = (size_t)y * width + x;
+    double px = juliaSet ? planeX(x) : 0.0;
+    double py = juliaSet ? planeY(y) : 0.0;
+    double cx = columnCx[x];
+    double cy = juliaSet ? seedY : planeY(y);
+
+    iters[i] = 0;
+    smooth[i] = -1.0f;
+    pixels[i] = Palette::rgba(0, 0, 0);
+    int steps = iter + (y < passRow ? 1 : 0);
+    for (int k = 1; k <= steps; ++k) {
+      Formula::step(px, py, cx, cy);
+      if (Formula::done(px, py)) {
+        iters[i] = k;
+        smooth[i] = Formula::value(k, px, py, maxIter);
+        break;
+      }
+    }
+    zx[i] = px;
+    zy[i] = py;
+  }
+
+
+  // Moves the contents of a width x height buffer by (dx, dy). Cells the
+  // move exposes keep stale values until they are marked pending.
+  template <class T> void shiftBuffer(std::vector<T> &v, int dx, int dy) {
+    size_t cols = width - std::abs(dx);
+    int sx = std::max(0, -dx), tx = std::max(0, dx);
+    auto moveRow = [&](int y) {
+      std::memmove(&v[(size_t)(y + dy) * width + tx],
+                   &v[(size_t)y * width + sx], cols * sizeof(T));
+    };
+    if (dy > 0)
+      for (int y = height - 1 - dy; y >= 0; --y)
+        moveRow(y);
+    else
+      for (int y = -dy; y < height; ++y)
+        moveRow(y);
+  }
+
+  void markPending(int y, int x0, int x1) {
+    for (size_t i = (size_t)y * width + x0; i < (size_t)y * width + x1; ++i) {
+      iters[i] = -1;
+      smooth[i] = -1.0f;
+      pixels[i] = Palette::rgba(0, 0, 0);
+    }
+    pending[y].x0 = std::min(pending[y].x0, x0);
+    pending[y].x1 = std::max(pending[y].x1, x1);
+  }
+
+  // Computes the pending pixels a batch of rows at a time, until none are
+  // left or the budget (if any) runs out.
+  void resolvePending(const FrameBudget *budget) {
+    int batch = ThreadPool::instance().workers();
+    std::vector<int> rows;
+    int y = 0;
+
+    while (pendingRows > 0) {
+      if (budget && budget->expired())
+        return;
+
+      rows.clear();
+      for (; y < height && (int)rows.size() < batch; ++y)
+        if (pending[y].x0 < pending[y].x1)
+          rows.push_back(y);
+
+      std::atomic<long> running{0};
+      parallelFor(0, rows.size(), 1, [&](size_t lo, size_t hi) {
+        long local = 0;
+        for (size_t k = lo; k < hi; ++k) {
+          int r = rows[k];
+          for (int x = pending[r].x0; x < pending[r].x1; ++x) {
+            if (iters[(size_t)r * width + x] != -1)
+              continue;
+            computePixel(x, r);
+            local += iters[(size_t)r * width + x] == 0;
+          }
+        }
+        running += local;
+      });
+
+      for (int r : rows) {
+        markDirty(r, pending[r].x0, pending[r].x1);
+        pending[r] = DirtySpan{width, 0};
+      }
+      pendingRows -= (int)rows.size();
+      alive += running.load();
+      passDirty = true;
+    }
+  }
+
+  // Advances the rows from the pass cursor on by one step, a batch of rows
+  // at a time, until the budget runs out. Returns true once every row has
+  // taken the step.
+  bool advancePass(const FrameBudget &budget) {
+    int batch = ThreadPool::instance().workers() * 4;
+    if (passRow == 0)
+      passAlive = alive;
+
+    while (passRow < height) {
+      if (budget.expired())
+        return false;
+      int y1 = std::min(height, passRow + batch);
+      stepRows(passRow, y1);
+      passRow = y1;
+      passDirty = true;
+    }
+
+    passRow = 0;
+    counters.iterations += passAlive;
+    return true;
+  }
+
+  void stepRows(int rowBegin, int rowEnd) {
+    const int n = iter + 1;
+    std::atomic<long> escapedNow{0};
+
+    parallelFor(rowBegin, rowEnd, 1, [&](size_t y0, size_t y1) {
+      long local = 0;
+      for (size_t y = y0; y < y1; ++y) {
+        size_t i = y * width;
+        double cy = juliaSet ? seedY : planeY((double)y);
+        int first = width, last = 0;
+        local += escapeStepRow<Formula>(&zx[i], &zy[i], &iters[i],
+                                        &smooth[i], width, columnCx.data(),
+                                        cy, n, maxIter, first, last);
+        if (first < last)
+          markDirty((int)y, first, last);
+      }
+      escapedNow += local;
+    });
+
+    alive -= escapedNow.load();
+    counters.pixelsResolved += escapedNow.load();
+  }
+
+  // Finished renders are kept in the disk cache as the integer iteration
+  // buffer followed by the smooth value buffer. Checkpoints are keyed
+  // without the view center, which they store themselves, so a restart
+  // finds the last view rendered at this size.
+  uint64_t diskKey(bool withCenter = true) const {
+    struct {
+      char name[32];
+      int32_t maxIter, julia, w, h;
+      double seedX, seedY, centerX, centerY;
+    } params{};
+    std::strncpy(params.name, getName(), sizeof(params.name) - 1);
+    params.maxIter = maxIter;
+    params.julia = juliaSet;
+    params.w = width;
+    params.h = height;
+    params.seedX = seedX;
+    params.seedY = seedY;
+    if (withCenter) {
+      params.centerX = centerX;
+      params.centerY = centerY;
+    }
+    return DiskCache::instance().key(&params, sizeof(params));
+  }
+
+  bool loadFromDisk() {
+    size_t n = (size_t)width * height;
+    MappedRender m =
+        DiskCache::instance().load(diskKey(), width, height, n * 8);
+    if (!m)
+      return false;
+
+    const char *src = (const char *)m.data();
+    std::memcpy(iters.data(), src, n * sizeof(int));
+    std::memcpy(smooth.data(), src + n * sizeof(int), n * sizeof(float));
+
+    iter = maxIter;
+    alive = (long)std::count(iters.begin(), iters.end(), 0);
+    return true;
+  }
+
+  void saveToDisk() {
+    if (!DiskCache::instance().enabled())
+      return;
+
+    size_t n = (size_t)width * height;
+    std::vector<char> payload(n * 8);
+    std::memcpy(payload.data(), iters.data(), n * sizeof(int));
+    std::memcpy(payload.data() + n * sizeof(int), smooth.data(),
+                n * sizeof(float));
+    DiskCache::instance().store(diskKey(), width, height, std::move(payload));
+  }
+
+  struct CheckpointState {
+    double centerX, centerY;
+    int32_t iter, passRow;
+    int64_t passAlive;
+    uint64_t iterations, pixelsResolved;
+  };
+
+  // A row record holds a span of zx, then zy, iters and smooth.
+  static constexpr uint32_t checkpointPixelBytes =
+      2 * sizeof(double) + sizeof(int) + sizeof(float);
+
+  bool resumeCheckpoint() {
+    CheckpointState s;
+    bool ok = checkpoint.resume(
+        diskKey(false), width, height, checkpointPixelBytes, &s, sizeof(s),
+        [&](int y, int x0, int x1, const char *src) {
+          size_t i = (size_t)y * width + x0, m = x1 - x0;
+          std::memcpy(&zx[i], src, m * sizeof(double));
+          src += m * sizeof(double);
+          std::memcpy(&zy[i], src, m * sizeof(double));
+          src += m * sizeof(double);
+          std::memcpy(&iters[i], src, m * sizeof(int));
+          src += m * sizeof(int);
+          std::memcpy(&smooth[i], src, m * sizeof(float));
+        });
+    if (!ok)
+      return false;
+
+    centerX = s.centerX;
+    centerY = s.centerY;
+    for (int x = 0; x < width; ++x)
+      columnCx[x] = juliaSet ? seedX : planeX(x);
+
+    iter = s.iter;
+    passRow = s.passRow;
+    passAlive = (long)s.passAlive;
+    counters.iterations = s.iterations;
+    counters.pixelsResolved = s.pixelsResolved;
+    alive = (long)std::count(iters.begin(), iters.end(), 0);
+
+    checkpointFresh = false;
+    runningSpans();
+    return true;
+  }
+
+  void startCheckpoint() {
+    CheckpointState s{centerX,   centerY,
+                      iter,      passRow,
+                      passAlive, counters.iterations,
+                      counters.pixelsResolved};
+    checkpointBusy = true;
+    checkpointWriter = std::thread([this, s] {
+      checkpointOk = writeCheckpoint(s);
+      checkpointBusy = false;
+    });
+  }
+
+  // Waits for the checkpoint being written, if any. With cancel set the
+  // writer stops at the next row and the log is rolled back to its last
+  // commit; anything that changes the buffers cancels first.
+  void finishCheckpoint(bool cancel) {
+    if (!checkpointWriter.joinable())
+      return;
+    checkpointCancel = cancel;
+    checkpointWriter.join();
+    checkpointCancel = false;
+
+    checkpointFresh = !checkpointOk;
+  }
+
+  // Escaped pixels never change again, so each checkpoint only writes the
+  // spans that were still running at the previous one. A fresh log, or
+  // one grown past twice the size of a full snapshot, is rewritten whole.
+  // Runs on checkpointWriter.
+  bool writeCheckpoint(const CheckpointState &s) {
+    size_t full = (size_t)width * height * checkpointPixelBytes;
+    if (checkpointFresh || checkpoint.size() > 2 * full) {
+      if (!checkpoint.create(diskKey(false), width, height,
+                             checkpointPixelBytes))
+        return false;
+      checkpointSpans.assign(height, DirtySpan{0, width});
+    }
+
+    for (int y = 0; y < height; ++y) {
+      if (checkpointCancel) {
+        checkpoint.rollback();
+        return false;
+      }
+      DirtySpan span = checkpointSpans[y];
+      if (span.x0 >= span.x1)
+        continue;
+      size_t i = (size_t)y * width + span.x0, m = span.x1 - span.x0;
+      iovec parts[] = {{&zx[i], m * sizeof(double)},
+                       {&zy[i], m * sizeof(double)},
+                       {&iters[i], m * sizeof(int)},
+                       {&smooth[i], m * sizeof(float)}};
+      if (!checkpoint.appendRow(y, span.x0, span.x1, parts, 4))
+        break;
+    }
+
+    if (!checkpoint.commit(&s, sizeof(s)))
+      return false;
+    runningSpans();
+    return true;
+  }
+
+  void runningSpans() {
+    checkpointSpans.resize(height);
+    for (int y = 0; y < height; ++y) {
+      const int *row = &iters[(size_t)y * width];
+      DirtySpan span{width, 0};
+      for (int x = 0; x < width; ++x) {
+        if (row[x] == 0) {
+          span.x0 = std::min(span.x0, x);
+          span.x1 = x + 1;
+        }
+      }
+      checkpointSpans[y] = span;
+    }
+  }
+
+  float sampleAt(double fx, double fy) const {
+    int n;
+    double px = planeX(fx), py = planeY(fy);
+    if (juliaSet)
+      return escapeSmooth<Formula>(px, py, seedX, seedY, maxIter, n);
+    return escapeSmooth<Formula>(0.0, 0.0, px, py, maxIter, n);
+  }
+
+  uint32_t colorOf(float t, int offset) const {
+    if (t < 0.0f)
+      return Palette::rgba(0, 0, 0);
+    if (equalize)
+      t = eqLut[std::min((int)(t * eqBins), eqBins - 1)];
+    return palette.at((int)(t * density * Palette::size) + offset);
+  }
+
+  void buildEqualization() {
+    std::vector<uint32_t> hist(eqBins, 0);
+    size_t total = 0;
+    for (float t : smooth) {
+      if (t < 0.0f)
+        continue;
+      hist[std::min((int)(t * eqBins), eqBins - 1)]++;
+      total++;
+    }
+
+    eqLut.resize(eqBins);
+    size_t acc = 0;
+    for (int b = 0; b < eqBins; ++b) {
+      acc += hist[b];
+      eqLut[b] = total ? (float)acc / total : 0.0f;
+    }
+  }
+
+  // When only passes have run since the last call, just the pixels that
+  // escaped in them (the dirty spans stepRows() marked) are recolored and
+  // uploaded. Anything else, and equalization, which depends on every
+  // pixel, recolors and uploads the whole image.
+  void colorize() {
+    bool full = dataDirty || colorDirty || equalize;
+    if (equalize && (dataDirty || passDirty || eqLut.empty()))
+      buildEqualization();
+
+    int offset = (int)paletteOffset;
+
+    // While orbits are still running, unresolved pixels keep whatever
+    // placeholder they hold, such as the scaled image from before a resize.
+    bool iterating = alive > 0 && iter < maxIter;
+
+    parallelFor(0, height, 16, [&](size_t y0, size_t y1) {
+      for (size_t y = y0; y < y1; ++y) {
+        DirtySpan span = full ? DirtySpan{0, width} : dirtyRow((int)y);
+        for (size_t i = y * width + span.x0; i < y * width + span.x1; ++i) {
+          if (iterating && smooth[i] < 0.0f)
+            continue;
+          pixels[i] = colorOf(smooth[i], offset);
+        }
+      }
+    });
+
+    const auto &refined = sampler.getRefined();
+    const auto &values = sampler.getValues();
+    int spp = sampler.samplesPerPixel();
+
+    parallelFor(0, refined.size(), 256, [&](size_t lo, size_t hi) {
+      for (size_t k = lo; k < hi; ++k) {
+        uint32_t r = 0, g = 0, b = 0;
+        for (int s = 0; s < spp; ++s) {
+          uint32_t c = colorOf(values[refined[k].offset + s], offset);
+          r += c >> 24;
+          g += (c >> 16) & 0xFF;
+          b += (c >> 8) & 0xFF;
+        }
+        pixels[refined[k].idx] =
+            Palette::rgba(uint8_t(r / spp), uint8_t(g / spp), uint8_t(b / spp));
+      }
+    });
+
+    if (full)
+      markAllDirty();
+    uploadDirty(pixels.data());
+    dataDirty = false;
+    passDirty = false;
+    colorDirty = false;
+  }
+
+  const float passRate;
+  static constexpr int eqBins = 4096;
+  static constexpr float cycleSpeed = 120.0f;
+
+  std::vector<double> zx, zy;
+  std::vector<double> columnCx;
+  std::vector<int> iters;
+  std::vector<float> smooth;
+  std::vector<uint32_t> pixels;
+  std::vector<uint32_t> scratch;
+  std::vector<float> eqLut;
+
+  // Per row, the span holding pixels exposed by a pan and not computed yet.
+  std::vector<DirtySpan> pending;
+  int pendingRows = 0;
+
+  int iter = 0;
+  int passRow = 0;
+  long alive = 0;
+  long passAlive = 0;
+  float passAcc = 0.0f;
+
+  float paletteOffset = 0.0f;
+  bool cycling = false;
+  bool equalize = false;
+  bool dataDirty = false;
+  bool passDirty = false;
+  bool colorDirty = false;
+  bool persisted = false;
+  bool fromDisk = false;
+  bool resumed = false;
+
+  CheckpointLog checkpoint;
+  // Per row, the span that may have changed since the last checkpoint.
+  std::vector<DirtySpan> checkpointSpans;
+  std::thread checkpointWriter;
+  std::atomic<bool> checkpointBusy{false};
+  std::atomic<bool> checkpointCancel{false};
+  bool checkpointOk = false;
+  bool checkpointFresh = true;
+  // Set only while resize() runs.
+  bool resumable = false;
+  float checkpointAcc = 0.0f;
+
+  AdaptiveSampler sampler;
+};
@@ -1,14 +1,20 @@
 #include "factory.h"
 
 #include "animated_tree.cpp"
+#include "buddhabrot.cpp"
+#include "burning_ship.cpp"
+#include "flame.cpp"
 #include "hilbert_curve.cpp"
 #include "julia.cpp"
 #include "koch_snowflake.cpp"
 #include "mandelbrot.cpp"
 #include "menger.cpp"
+#include "multibrot.cpp"
+#include "newton.cpp"
 #include "plasma.cpp"
 #include "pythagoras.cpp"
 #include "sierpinski.cpp"
+#include "tricorn.cpp"
 
 std::unique_ptr<FractalFB> createFractal(FractalType t, SDL_Renderer *r) {
   switch (t) {
@@ -30,15 +36,40 @@ std::unique_ptr<FractalFB> createFractal(FractalType t, SDL_Renderer *r) {
     return std::make_unique<HilbertCurve>(r);
   case FractalType::ANIMATED_TREE:
     return std::make_unique<AnimatedTree>(r);
+  case FractalType::BUDDHABROT:
+    return std::make_unique<Buddhabrot>(r);
+  case FractalType::FLAME:
+    return std::make_unique<Flame>(r);
+  case FractalType::BURNING_SHIP:
+    return std::make_unique<BurningShip>(r);
+  case FractalType::TRICORN:
+    return std::make_unique<Tricorn>(r);
+  case FractalType::MULTIBROT:
+    return std::make_unique<Multibrot>(r);
+  case FractalType::NEWTON:
+    return std::make_unique<Newton>(r);
   default:
     return {};
   }
 }
 
+bool canPrewarm(FractalType t) {
+  switch (t) {
+  case FractalType::ANIMATED_TREE:
+  case FractalType::BUDDHABROT:
+  case FractalType::FLAME:
+    return false;
+  default:
+    return true;
+  }
+}
+
 const char *getFractalName(FractalType t) {
   static const char *names[] = {
       "Mandelbrot",     "Julia",         "Plasma",
       "Koch Snowflake", "Menger Sponge", "Pythagoras Tree",
-      "Sierpinski",     "Hilbert Curve", "Animated Tree"};
+      "Sierpinski",     "Hilbert Curve", "Animated Tree",
+      "Buddhabrot",     "Fractal Flame", "Burning Ship",
+      "Tricorn",        "Multibrot z^3", "Newton"};
   return names[(int)t];
 }
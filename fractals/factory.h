@@ -3,4 +3,9 @@
 #include <memory>
 
 std::unique_ptr<FractalFB> createFractal(FractalType type, SDL_Renderer *r);
-const char *getFractalName(FractalType type);
\ No newline at end of file
+const char *getFractalName(FractalType type);
+
+// False for types that are not worth computing in the background: the
+// animation, which never settles, and the sampling renderers, which keep
+// every pool worker busy for minutes before they converge.
+bool canPrewarm(FractalType type);
\ No newline at end of file
@@ -0,0 +1,314 @@
+#include "budget.h"
+#include "fractal.h"
+#include "kernels.h"
+#include "palette.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Iterated function systems rendered with the chaos game, fractal-flame
+// style. Every pool worker advances its own batch of flameLanes points
+// with flameStep() and bins them into a private density buffer (hit count
+// and summed color per pixel). The buffers are folded into the image a few
+// times a second of wall time, split by pixel range so nothing is locked,
+// and shown with log-density tone mapping. Like Buddhabrot's histograms,
+// the private buffers are capped at ThreadPool::privateBufferBytes.
+class Flame : public FractalFB {
+public:
+  Flame(SDL_Renderer *r) : FractalFB(r), palette(Palette::Preset::CLASSIC) {
+    setPreset(0);
+  }
+
+  void reset() override {
+    size_t n = (size_t)width * height;
+    int workers =
+        ThreadPool::instance().workersFor(2 * n * sizeof(uint32_t));
+
+    density.assign(n, 0.0);
+    colorSum.assign(n, 0.0);
+    pixels.assign(n, Palette::rgba(0, 0, 0));
+    buffers.assign(workers, std::vector<uint32_t>(2 * n, 0));
+
+    walkers.assign(workers, Walker{});
+    for (int t = 0; t < workers; ++t) {
+      Walker &w = walkers[t];
+      w.key = counterHash(0x5eedull + generation, t);
+      for (int l = 0; l < flameLanes; ++l)
+        reseed(w, l);
+    }
+    generation++;
+
+    const Preset &p = presets()[preset];
+    scale = p.extent / std::min(width, height);
+    points = 0;
+    samplingSeconds = 0.0;
+    lastMerge = SDL_GetPerformanceCounter();
+    converged = false;
+    clear();
+  }
+
+  bool update(float, uint32_t maxMs) override {
+    if (converged)
+      return false;
+
+    FrameBudget budget(maxMs);
+
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now - lastMerge >=
+        (Uint64)(displayInterval * SDL_GetPerformanceFrequency())) {
+      lastMerge = now;
+      merge();
+      toneMap();
+      if (points >= targetPerPixel * (uint64_t)width * height) {
+        converged = true;
+        return false;
+      }
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    ThreadPool::instance().run((int)walkers.size(),
+                               [&](int t) { iterate(walkers[t], t, budget); });
+    samplingSeconds += double(SDL_GetPerformanceCounter() - start) /
+                       SDL_GetPerformanceFrequency();
+
+    for (Walker &w : walkers) {
+      points += w.points;
+      counters.iterations += w.points;
+      counters.primitives += w.points;
+      w.points = 0;
+    }
+    return true;
+  }
+
+  bool handleKey(SDL_Keycode key) override {
+    switch (key) {
+    case SDLK_n:
+      setPreset((preset + 1) % (int)presets().size());
+      reset();
+      return true;
+    case SDLK_c:
+      palette.next();
+      toneMap();
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  std::string getStatus() const override {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s | Points: %.1fM (%.1fM/s)%s",
+             presets()[preset].name, points * 1e-6,
+             points * 1e-6 / std::max(samplingSeconds, 1e-9),
+             converged ? " | Done" : "");
+    return buf;
+  }
+
+  size_t memoryBytes() const override {
+    size_t bytes = FractalFB::memoryBytes() +
+                   (density.capacity() + colorSum.capacity()) * sizeof(double) +
+                   pixels.capacity() * sizeof(uint32_t);
+    for (const auto &b : buffers)
+      bytes += b.capacity() * sizeof(uint32_t);
+    return bytes;
+  }
+
+  const char *getName() const override { return "Fractal Flame"; }
+
+private:
+  struct Preset {
+    const char *name;
+    std::vector<FlameXform> xforms;
+    std::vector<float> weights;
+    float centerX, centerY, extent;
+  };
+
+  static const std::vector<Preset> &presets() {
+    // a b c d e f | linear sinusoidal spherical swirl horseshoe | color
+    static const std::vector<Preset> list = {
+        {"Sierpinski",
+         {{0.5f, 0, 0, 0, 0.5f, 0, 1, 0, 0, 0, 0, 0.0f},
+          {0.5f, 0, 0.5f, 0, 0.5f, 0, 1, 0, 0, 0, 0, 0.4f},
+          {0.5f, 0, 0.25f, 0, 0.5f, 0.433f, 1, 0, 0, 0, 0, 0.8f}},
+         {1, 1, 1},
+         0.5f,
+         0.42f,
+         1.1f},
+        {"Fern",
+         {{0, 0, 0, 0, 0.16f, 0, 1, 0, 0, 0, 0, 0.0f},
+          {0.85f, 0.04f, 0, -0.04f, 0.85f, 1.6f, 1, 0, 0, 0, 0, 0.35f},
+          {0.2f, -0.26f, 0, 0.23f, 0.22f, 1.6f, 1, 0, 0, 0, 0, 0.7f},
+          {-0.15f, 0.28f, 0, 0.26f, 0.24f, 0.44f, 1, 0, 0, 0, 0, 0.8f}},
+         {0.01f, 0.85f, 0.07f, 0.07f},
+         0.3f,
+         5.0f,
+         10.5f},
+        {"Swirl",
+         {{0.56f, -0.39f, 0.1f, 0.39f, 0.56f, 0.2f, 0.4f, 0, 0, 0.6f, 0, 0.0f},
+          {-0.49f, 0.19f, 0.5f, -0.18f, -0.52f, -0.1f, 0, 1, 0, 0, 0, 0.5f},
+          {0.35f, 0.2f, -0.6f, -0.2f, 0.35f, 0.3f, 0.3f, 0, 0.7f, 0, 0, 1.0f}},
+         {0.4f, 0.35f, 0.25f},
+         -0.4f,
+         0.1f,
+         3.4f},
+        {"Horseshoe",
+         {{0.6f, 0.3f, 0.0f, -0.3f, 0.6f, 0.0f, 0, 0, 0, 0, 1, 0.0f},
+          {0.4f, -0.5f, 0.4f, 0.5f, 0.4f, 0.2f, 0.5f, 0, 0.5f, 0, 0, 0.6f},
+          {-0.3f, 0.1f, -0.4f, 0.2f, 0.5f, -0.3f, 0, 0.8f, 0, 0.2f, 0, 1.0f}},
+         {0.4f, 0.3f, 0.3f},
+         0.0f,
+         0.0f,
+         3.2f},
+    };
+    return list;
+  }
+
+  struct Walker {
+    float x[flameLanes], y[flameLanes], c[flameLanes];
+    int fuse[flameLanes];
+    uint64_t key = 0, counter = 0, points = 0;
+  };
+
+  void setPreset(int p) {
+    preset = p;
+    const Preset &pr = presets()[p];
+
+    float total = 0.0f;
+    for (float w : pr.weights)
+      total += w;
+    cumulative.clear();
+    float acc = 0.0f;
+    for (float w : pr.weights)
+      cumulative.push_back(acc += w / total);
+    cumulative.back() = 1.0f;
+
+    used = 0;
+    for (const FlameXform &x : pr.xforms) {
+      used |= (x.linear != 0.0f ? FLAME_LINEAR : 0u) |
+              (x.sinusoidal != 0.0f ? FLAME_SINUSOIDAL : 0u) |
+              (x.spherical != 0.0f ? FLAME_SPHERICAL : 0u) |
+              (x.swirl != 0.0f ? FLAME_SWIRL : 0u) |
+              (x.horseshoe != 0.0f ? FLAME_HORSESHOE : 0u);
+    }
+  }
+
+  // A fresh point needs a few steps to land on the attractor before it is
+  // plotted.
+  void reseed(Walker &w, int l) {
+    w.x[l] = counterUniform(w.key, w.counter++) * 2.0f - 1.0f;
+    w.y[l] = counterUniform(w.key, w.counter++) * 2.0f - 1.0f;
+    w.c[l] = counterUniform(w.key, w.counter++);
+    w.fuse[l] = fuseSteps;
+  }
+
+  void iterate(Walker &w, int t, const FrameBudget &budget) {
+    const Preset &p = presets()[preset];
+    const FlameXform *xf = p.xforms.data();
+    const int nx = (int)p.xforms.size();
+    uint32_t *buf = buffers[t].data();
+
+    const float inv = 1.0f / scale;
+    const float ox = width * 0.5f - p.centerX * inv;
+    const float oy = height * 0.5f + p.centerY * inv;
+
+    while (!budget.expired()) {
+      for (int s = 0; s < stepsPerCheck; ++s) {
+        flameStep(w.x, w.y, w.c, xf, cumulative.data(), nx, used, w.key,
+                  w.counter);
+        w.counter += flameLanes;
+
+        for (int l = 0; l < flameLanes; ++l) {
+          if (!(std::fabs(w.x[l]) < 1e6f && std::fabs(w.y[l]) < 1e6f)) {
+            reseed(w, l);
+            continue;
+          }
+          if (w.fuse[l] > 0) {
+            w.fuse[l]--;
+            continue;
+          }
+          int px = (int)(w.x[l] * inv + ox);
+          int py = (int)(oy - w.y[l] * inv);
+          if ((unsigned)px < (unsigned)width &&
+              (unsigned)py < (unsigned)height) {
+            size_t i = 2 * ((size_t)py * width + px);
+            buf[i]++;
+            buf[i + 1] += (uint32_t)(w.c[l] * 255.0f);
+          }
+        }
+      }
+      w.points += (uint64_t)stepsPerCheck * flameLanes;
+    }
+  }
+
+  void merge() {
+    parallelFor(0, density.size(), 16384, [&](size_t lo, size_t hi) {
+      for (auto &b : buffers) {
+        for (size_t i = lo; i < hi; ++i) {
+          density[i] += b[2 * i];
+          colorSum[i] += b[2 * i + 1] * (1.0 / 255.0);
+          b[2 * i] = b[2 * i + 1] = 0;
+        }
+      }
+    });
+  }
+
+  // Brightness is log(1 + hits) relative to a high percentile of the lit
+  // pixels, with display gamma; hue is the pixel's mean color coordinate.
+  void toneMap() {
+    std::vector<double> lit;
+    for (size_t i = 0; i < density.size(); i += 7)
+      if (density[i] > 0.0)
+        lit.push_back(density[i]);
+    if (lit.empty())
+      return;
+
+    size_t k = lit.size() * 995 / 1000;
+    std::nth_element(lit.begin(), lit.begin() + k, lit.end());
+    float invRef = 1.0f / (float)std::log1p(lit[k]);
+
+    parallelFor(0, density.size(), 16384, [&](size_t lo, size_t hi) {
+      for (size_t i = lo; i < hi; ++i) {
+        double d = density[i];
+        if (d <= 0.0) {
+          pixels[i] = Palette::rgba(0, 0, 0);
+          continue;
+        }
+        float v = std::min(1.0f, (float)std::log1p(d) * invRef);
+        v = std::pow(v, 1.0f / 2.2f);
+        uint32_t c =
+            palette.at((int)(colorSum[i] / d * (Palette::size - 1)));
+        pixels[i] = Palette::rgba(uint8_t((c >> 24) * v),
+                                  uint8_t(((c >> 16) & 0xFF) * v),
+                                  uint8_t(((c >> 8) & 0xFF) * v));
+      }
+    });
+    markAllDirty();
+    uploadDirty(pixels.data());
+  }
+
+  static constexpr int fuseSteps = 20;
+  static constexpr int stepsPerCheck = 256;
+  static constexpr uint64_t targetPerPixel = 4000;
+  static constexpr float displayInterval = 0.25f;
+
+  // The per-worker uint32 sums only hold one merge interval of hits; the
+  // running totals are doubles.
+  std::vector<std::vector<uint32_t>> buffers;
+  std::vector<Walker> walkers;
+  std::vector<double> density, colorSum;
+  std::vector<uint32_t> pixels;
+  std::vector<float> cumulative;
+  Palette palette;
+  unsigned used = 0;
+  int preset = 0;
+  float scale = 1.0f;
+  uint64_t points = 0;
+  uint64_t generation = 0;
+  double samplingSeconds = 0.0;
+  Uint64 lastMerge = 0;
+  bool converged = false;
+};
@@ -1,6 +1,9 @@
 #pragma once
 #include <SDL2/SDL.h>
+#include <algorithm>
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
 
 enum class FractalType {
@@ -13,9 +16,27 @@ enum class FractalType {
   SIERPINSKI,
   HILBERT_CURVE,
   ANIMATED_TREE,
+  BUDDHABROT,
+  FLAME,
+  BURNING_SHIP,
+  TRICORN,
+  MULTIBROT,
+  NEWTON,
   COUNT
 };
 
+// Work done by a fractal since it was created, and how much work is queued
+// right now. The counters are plain fields written on the update thread;
+// parallel work adds its totals once per batch.
+struct FractalMetrics {
+  uint64_t iterations = 0;     // orbit steps, subdivisions, expanded nodes
+  uint64_t pixelsResolved = 0; // pixels given their final value
+  uint64_t primitives = 0;     // lines, points and rectangles drawn
+  size_t queued = 0;           // pending areas, frontier, unresolved pixels
+  uint64_t allocations = 0;    // heap allocations by work-queue buffers
+  uint64_t levelsDropped = 0;  // levels skipped when the frame budget ran out
+};
+
 class Fractal {
 public:
   explicit Fractal(SDL_Renderer *r) : renderer(r) {}
@@ -31,24 +52,76 @@ public:
   virtual bool update(float dt, uint32_t maxMs) = 0;
   virtual void render() = 0;
   virtual const char *getName() const = 0;
+  virtual std::string getStatus() const { return {}; }
+  virtual bool handleKey(SDL_Keycode) { return false; }
+
+  // Pointer position in fractal pixels while it is over the view; inside is
+  // false once it leaves.
+  virtual void setPointer(bool, int, int) {}
+
+  // Moves the view so the image shifts by (dx, dy) pixels. Returns false
+  // for fractals with a fixed view.
+  virtual bool pan(int, int) { return false; }
+
+  // True for fractals that redraw every frame and never settle.
+  virtual bool isAnimated() const { return false; }
+
+  // Fractal pixels per window pixel. Animated fractals may be rendered
+  // below window resolution and stretched; those that draw at fixed pixel
+  // sizes multiply them by this so the picture keeps its proportions.
+  void setRenderScale(float s) { renderScale = s; }
+
+  // Jumps straight to animation time t (seconds at 1x speed). Only fractals
+  // whose frame is a pure function of time support this; the next update()
+  // then draws that frame and ignores the dt it is given.
+  virtual bool setTime(double) { return false; }
+
+  // For fractals whose pixels can be computed independently: the values
+  // of the w x h tile at (x0, y0) of a viewW x viewH view, and the colors
+  // for such values. The render farm calls these on a fractal that was
+  // never resized. computeTile() returns false if it is unsupported.
+  virtual bool computeTile(int, int, int, int, int, int, float *) const {
+    return false;
+  }
+  virtual void colorTile(const float *, size_t, uint32_t *) const {}
+
+  // Approximate bytes held for per-pixel and per-item state.
+  virtual size_t memoryBytes() const { return 0; }
+
+  // Fractals with a work queue override this to fill in its size.
+  virtual FractalMetrics metrics() const { return counters; }
 
 protected:
   SDL_Renderer *renderer{};
   int width{}, height{};
+  float renderScale = 1.0f;
+  FractalMetrics counters;
 };
 
 class FractalFB : public Fractal {
 public:
   explicit FractalFB(SDL_Renderer *r) : Fractal(r) {}
 
+  // Fractals that can carry their computed state over to the new size do
+  // so in reproject(); everything else starts over.
   void resize(int w, int h) override {
+    if (texture && w == width && h == height)
+      return;
+
+    int oldW = width, oldH = height;
+    bool hadState = texture != nullptr;
+
     width = w;
     height = h;
     if (texture)
       SDL_DestroyTexture(texture);
     texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
                                 SDL_TEXTUREACCESS_TARGET, width, height);
-    reset();
+    dirty.assign(height, DirtySpan{width, 0});
+    allDirty = true;
+
+    if (!hadState || !reproject(oldW, oldH))
+      reset();
   }
 
   virtual ~FractalFB() {
@@ -60,13 +133,83 @@ public:
     SDL_RenderCopy(renderer, texture, nullptr, nullptr);
   }
 
+  size_t memoryBytes() const override { return (size_t)width * height * 4; }
+
+  // Bytes sent to the texture by uploadDirty() so far.
+  uint64_t uploadedBytes() const { return uploaded; }
+
 protected:
   SDL_Texture *texture = nullptr;
 
+  virtual bool reproject(int, int) { return false; }
+
+  // Fractals that keep a CPU copy of the texture mark the pixels they
+  // change and upload with uploadDirty(). Each row keeps the span of
+  // changed columns; rows may be marked concurrently as long as every row
+  // is only marked by one thread at a time.
+  struct DirtySpan {
+    int x0, x1; // empty when x0 >= x1
+  };
+
+  void markDirty(int y, int x0, int x1) {
+    DirtySpan &s = dirty[y];
+    s.x0 = std::min(s.x0, x0);
+    s.x1 = std::max(s.x1, x1);
+  }
+
+  void markAllDirty() { allDirty = true; }
+
+  DirtySpan dirtyRow(int y) const { return dirty[y]; }
+
+  // Sends the union of the dirty spans of every band of dirtyBand rows as
+  // one rectangle, skipping clean bands, and clears the marks. Returns
+  // false, having uploaded nothing, if nothing was marked.
+  bool uploadDirty(const uint32_t *pixels) {
+    if (allDirty) {
+      SDL_UpdateTexture(texture, nullptr, pixels, width * 4);
+      uploaded += (uint64_t)width * height * 4;
+      std::fill(dirty.begin(), dirty.end(), DirtySpan{width, 0});
+      allDirty = false;
+      return true;
+    }
+
+    bool any = false;
+    for (int y0 = 0; y0 < height; y0 += dirtyBand) {
+      int y1 = std::min(height, y0 + dirtyBand);
+      int x0 = width, x1 = 0, r0 = y1, r1 = y0;
+      for (int y = y0; y < y1; ++y) {
+        DirtySpan &s = dirty[y];
+        if (s.x0 >= s.x1)
+          continue;
+        x0 = std::min(x0, s.x0);
+        x1 = std::max(x1, s.x1);
+        r0 = std::min(r0, y);
+        r1 = y + 1;
+        s = DirtySpan{width, 0};
+      }
+      if (x0 >= x1)
+        continue;
+
+      SDL_Rect rect = {x0, r0, x1 - x0, r1 - r0};
+      SDL_UpdateTexture(texture, &rect, pixels + (size_t)r0 * width + x0,
+                        width * 4);
+      uploaded += (uint64_t)rect.w * rect.h * 4;
+      any = true;
+    }
+    return any;
+  }
+
   void clear() {
     SDL_SetRenderTarget(renderer, texture);
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
     SDL_SetRenderTarget(renderer, nullptr);
   }
+
+private:
+  static constexpr int dirtyBand = 64;
+
+  std::vector<DirtySpan> dirty;
+  bool allDirty = true;
+  uint64_t uploaded = 0;
 };
@@ -1,24 +1,24 @@
-#include "fractal.h"
+#include "budget.h"
+#include "kernels.h"
+#include "line_raster.h"
 #include <algorithm>
 #include <cmath>
 #include <vector>
 
-class HilbertCurve : public FractalFB {
+class HilbertCurve : public LineFractal {
 public:
-  HilbertCurve(SDL_Renderer *r) : FractalFB(r) {}
+  HilbertCurve(SDL_Renderer *r) : LineFractal(r) {}
 
-  struct Point {
-    float x, y;
-  };
+  using Point = Point2f;
 
   void reset() override {
-    clear();
+    clearCanvas();
     level = 1;
     accSteps = 0.0f;
     currentDrawIdx = 0;
     done = false;
 
-    generatePath();
+    startPath();
   }
 
   bool update(float dt, uint32_t maxMs) override {
@@ -27,26 +27,26 @@ public:
       return false;
     }
 
-    uint32_t start = SDL_GetTicks();
-    SDL_SetRenderTarget(renderer, texture);
+    FrameBudget budget(maxMs);
 
     float speed = 30.0f + (std::pow(4, level) * 0.5f);
     accSteps += dt * speed;
 
+    extendPath(budget, currentDrawIdx + (int)std::min(accSteps, 1e8f) + 2);
+
     while (accSteps >= 1.0f) {
-      if (SDL_GetTicks() - start >= maxMs)
+      if (budget.expired())
         break;
 
-      if (currentDrawIdx < (int)path.size() - 1) {
-
-        float progress = (float)currentDrawIdx / path.size();
-        setRainbowColor(progress);
+      if (currentDrawIdx < totalPoints - 1) {
+        if (currentDrawIdx + 1 >= (int)path.size())
+          break;
 
+        float progress = (float)currentDrawIdx / totalPoints;
         Point p1 = path[currentDrawIdx];
         Point p2 = path[currentDrawIdx + 1];
 
-        SDL_RenderDrawLine(renderer, (int)p1.x, (int)p1.y, (int)p2.x,
-                           (int)p2.y);
+        drawLine(p1.x, p1.y, p2.x, p2.y, rainbowColor(progress));
 
         currentDrawIdx++;
         accSteps -= 1.0f;
@@ -54,10 +54,8 @@ public:
 
         if (level < MAX_LEVEL) {
           level++;
-          generatePath();
-
-          SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-          SDL_RenderClear(renderer);
+          startPath();
+          clearCanvas();
 
           currentDrawIdx = 0;
           accSteps = 0.0f;
@@ -69,67 +67,67 @@ public:
       }
     }
 
-    SDL_SetRenderTarget(renderer, nullptr);
+    flushLines();
     drawToScreen();
     return !done;
   }
 
+  size_t memoryBytes() const override {
+    return LineFractal::memoryBytes() + path.capacity() * sizeof(Point);
+  }
+
+  FractalMetrics metrics() const override {
+    FractalMetrics m = LineFractal::metrics();
+    m.queued = done ? 0 : totalPoints - 1 - currentDrawIdx;
+    return m;
+  }
+
   const char *getName() const override { return "Hilbert Curve"; }
 
 private:
-  void setRainbowColor(float p) {
-
+  static uint32_t rainbowColor(float p) {
     Uint8 r = (Uint8)(std::sin(p * 6.28f) * 127 + 128);
     Uint8 g = (Uint8)(std::sin(p * 6.28f + 2.0f) * 127 + 128);
     Uint8 b = (Uint8)(std::sin(p * 6.28f + 4.0f) * 127 + 128);
-    SDL_SetRenderDrawColor(renderer, r, g, b, 255);
+    return Palette::rgba(r, g, b);
   }
 
-  void generatePath() {
+  void startPath() {
     path.clear();
-    int n = (int)std::pow(2, level);
-    int totalPoints = n * n;
+    gridN = (int)std::pow(2, level);
+    totalPoints = gridN * gridN;
+    path.reserve(totalPoints);
 
     float margin = 40.0f;
     float availableSize = std::min(width, height) - (margin * 2.0f);
-    float step = availableSize / (n - 1);
+    gridStep = availableSize / (gridN - 1);
 
-    float offsetX = (width - (availableSize)) / 2.0f;
-    float offsetY = (height - (availableSize)) / 2.0f;
-
-    for (int i = 0; i < totalPoints; i++) {
-      Point p = d2xy(n, i);
-      path.push_back({p.x * step + offsetX, p.y * step + offsetY});
-    }
-  }
-
-  Point d2xy(int n, int d) {
-    Point p = {0, 0};
-    int t = d;
-    for (int s = 1; s < n; s <<= 1) {
-      int rx = 1 & (t / 2);
-      int ry = 1 & (t ^ rx);
-      rot(s, &p.x, &p.y, rx, ry);
-      p.x += s * (float)rx;
-      p.y += s * (float)ry;
-      t /= 4;
-    }
-    return p;
+    offsetX = (width - (availableSize)) / 2.0f;
+    offsetY = (height - (availableSize)) / 2.0f;
   }
 
-  void rot(int n, float *x, float *y, int rx, int ry) {
-    if (ry == 0) {
-      if (rx == 1) {
-        *x = (float)n - 1.0f - *x;
-        *y = (float)n - 1.0f - *y;
+  // Generates the path in chunks from where it left off, only as far as
+  // drawing needs it, so a deep level is never built within one frame.
+  void extendPath(const FrameBudget &budget, int want) {
+    want = std::min(totalPoints, want);
+    int i = (int)path.size();
+    while (i < want && !budget.expired()) {
+      int end = std::min(want, i + 4096);
+      counters.iterations += end - i;
+      for (; i < end; i++) {
+        Point p = hilbertD2xy(gridN, i);
+        path.push_back({p.x * gridStep + offsetX, p.y * gridStep + offsetY});
       }
-      std::swap(*x, *y);
     }
   }
 
   void drawToScreen() { SDL_RenderCopy(renderer, texture, nullptr, nullptr); }
 
   std::vector<Point> path;
+  int gridN = 0;
+  int totalPoints = 0;
+  float gridStep = 0.0f;
+  float offsetX = 0.0f, offsetY = 0.0f;
   int level = 1;
   int currentDrawIdx = 0;
   float accSteps = 0.0f;
@@ -1,90 +1,129 @@
-#include "fractal.h"
-
-class Julia : public FractalFB {
+#include "escape_time.h"
+#include "julia_preview.h"
+#include <cmath>
+
+// With realtime mode on (R), c travels around the circle |c| = 0.7885 and
+// every frame is drawn from scratch by JuliaPreview instead of the
+// progressive renderer, into its own texture. Resizes in realtime mode,
+// such as the resolution governor scaling it down, only size the preview,
+// and pans move it; both are applied to the progressive buffers when it
+// is turned off, so the progressive render survives the round trip.
+class Julia : public EscapeTimeFractal<QuadraticFormula> {
 public:
-  Julia(SDL_Renderer *r) : FractalFB(r) {}
-
-  void reset() override {
-    clear();
-    iter = 0;
-    iterAccumulator = 0.0f;
-    alive = width * height;
-
-    zx.assign(width * height, 0.0);
-    zy.assign(width * height, 0.0);
-    escaped.assign(width * height, false);
-
-    for (int y = 0; y < height; ++y) {
-      for (int x = 0; x < width; ++x) {
-        int i = y * width + x;
-        zx[i] = (x - width / 2.0) * 4.0 / width;
-        zy[i] = (y - height / 2.0) * 4.0 / width;
-      }
-    }
+  Julia(SDL_Renderer *r)
+      : EscapeTimeFractal(r, 500, 60.0f, Palette::Preset::CLASSIC, 8.0f) {
+    juliaSet = true;
+    seedX = -0.7;
+    seedY = 0.27015;
   }
 
-  bool update(float dt, uint32_t maxMs) override {
-    if (alive <= 0 || iter >= maxIter)
-      return false;
-
-    uint32_t start = SDL_GetTicks();
-    SDL_SetRenderTarget(renderer, texture);
-
-    iterAccumulator += dt * 60.0f;
-
-    while (iterAccumulator >= 1.0f && alive > 0 && iter < maxIter) {
+  ~Julia() override {
+    if (previewTexture)
+      SDL_DestroyTexture(previewTexture);
+  }
 
-      if (SDL_GetTicks() - start >= maxMs)
-        break;
+  void resize(int w, int h) override {
+    if (!realtime) {
+      EscapeTimeFractal::resize(w, h);
+      return;
+    }
+    previewW = w;
+    previewH = h;
+  }
 
-      for (int i = 0; i < width * height; ++i) {
-        if (escaped[i])
-          continue;
+  bool update(float dt, uint32_t maxMs) override {
+    if (!realtime)
+      return EscapeTimeFractal::update(dt, maxMs);
+
+    if (!previewTexture || previewW != textureW || previewH != textureH) {
+      if (previewTexture)
+        SDL_DestroyTexture(previewTexture);
+      previewTexture =
+          SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+                            SDL_TEXTUREACCESS_STREAMING, previewW, previewH);
+      textureW = previewW;
+      textureH = previewH;
+    }
 
-        double x = zx[i];
-        double y = zy[i];
+    angle = std::fmod(angle + dt * angularSpeed, 6.283185307179586);
+    preview.render(previewW, previewH, radius * std::cos(angle),
+                   radius * std::sin(angle), palette,
+                   density * Palette::size / maxIter, centerX + offsetX,
+                   centerY + offsetY);
+    counters.pixelsResolved += preview.samples();
+    SDL_UpdateTexture(previewTexture, nullptr, preview.data(), previewW * 4);
+    return true;
+  }
 
-        const double cx = -0.7;
-        const double cy = 0.27015;
+  void render() override {
+    if (realtime && previewTexture)
+      SDL_RenderCopy(renderer, previewTexture, nullptr, nullptr);
+    else
+      FractalFB::render();
+  }
 
-        double nx = x * x - y * y + cx;
-        double ny = 2.0 * x * y + cy;
+  bool handleKey(SDL_Keycode key) override {
+    if (key != SDLK_r)
+      return EscapeTimeFractal::handleKey(key);
 
-        zx[i] = nx;
-        zy[i] = ny;
+    realtime = !realtime;
+    if (realtime) {
+      previewW = width;
+      previewH = height;
+      preview.restart();
+      return true;
+    }
 
-        if (nx * nx + ny * ny > 4.0) {
-          escaped[i] = true;
-          alive--;
+    int dx = (int)std::lround(-offsetX * width / 4.0);
+    int dy = (int)std::lround(-offsetY * width / 4.0);
+    offsetX = offsetY = 0.0;
+    EscapeTimeFractal::pan(dx, dy);
+    return true;
+  }
 
-          int px = i % width;
-          int py = i / width;
+  bool pan(int dx, int dy) override {
+    if (!realtime)
+      return EscapeTimeFractal::pan(dx, dy);
 
-          Uint8 r = (iter * 7) % 255;
-          Uint8 g = (iter * 3) % 255;
-          Uint8 b = (iter * 11) % 255;
+    offsetX -= dx * 4.0 / previewW;
+    offsetY -= dy * 4.0 / previewW;
+    preview.restart();
+    return true;
+  }
 
-          SDL_SetRenderDrawColor(renderer, r, g, b, 255);
-          SDL_RenderDrawPoint(renderer, px, py);
-        }
-      }
+  std::string getStatus() const override {
+    if (!realtime)
+      return EscapeTimeFractal::getStatus();
+
+    char buf[128];
+    snprintf(buf, sizeof(buf),
+             "Realtime c = (%.3f, %.3f) | %.1f ms/frame (1/%d px) | "
+             "Palette: %s",
+             radius * std::cos(angle), radius * std::sin(angle),
+             preview.frameMs(), preview.interleave() * preview.interleave(),
+             palette.getName());
+    return buf;
+  }
 
-      iter++;
-      iterAccumulator -= 1.0f;
-    }
+  bool isAnimated() const override { return realtime; }
 
-    SDL_SetRenderTarget(renderer, nullptr);
-    return alive > 0 && iter < maxIter;
+  size_t memoryBytes() const override {
+    return EscapeTimeFractal::memoryBytes() + preview.memoryBytes() +
+           (size_t)textureW * textureH * 4;
   }
 
   const char *getName() const override { return "Julia"; }
 
 private:
-  std::vector<double> zx, zy;
-  std::vector<bool> escaped;
-  float iterAccumulator = 0.0f;
-
-  int iter = 0;
-  int alive = 0;
-  static constexpr int maxIter = 500;
-};
\ No newline at end of file
+  static constexpr double radius = 0.7885;
+  static constexpr double angularSpeed = 0.3;
+
+  JuliaPreview preview{2};
+  SDL_Texture *previewTexture = nullptr;
+  int previewW = 0, previewH = 0;
+  int textureW = 0, textureH = 0;
+  double angle = 0.0;
+  // Realtime pans not yet applied to the progressive buffers.
+  double offsetX = 0.0, offsetY = 0.0;
+  bool realtime = false;
+};
@@ -0,0 +1,98 @@
+#pragma once
+#include "kernels.h"
+#include "palette.h"
+#include "parallel.h"
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Whole-frame Julia renderer for a c that changes every frame: the realtime
+// Julia mode and the preview over Mandelbrot. It uses the float row kernel
+// at a fixed iteration count. With interleave 2 each frame computes one
+// pixel of every 2x2 block, cycling through the four over four frames, and
+// the rest keep their last value; the first frame after a restart fills
+// each block from its one sample. The view matches EscapeTimeFractal: four
+// units wide, centered on (viewX, viewY).
+class JuliaPreview {
+public:
+  static constexpr int maxIter = 128;
+
+  explicit JuliaPreview(int interleave) : step(interleave) {}
+
+  void restart() { frame = 0; }
+
+  // Draws the frame for c into the w x h pixel buffer. colorScale maps the
+  // smooth iteration count to a palette index.
+  void render(int w, int h, double cx, double cy, const Palette &palette,
+              float colorScale, double viewX = 0.0, double viewY = 0.0) {
+    if (w != width || h != height) {
+      width = w;
+      height = h;
+      pixels.assign((size_t)w * h, Palette::rgba(0, 0, 0));
+      frame = 0;
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    static const int order[4][2] = {{0, 0}, {1, 1}, {1, 0}, {0, 1}};
+    int phase = step == 1 ? 0 : frame % 4;
+    int ox = order[phase][0] % step, oy = order[phase][1] % step;
+    bool fill = step > 1 && frame == 0;
+    int cols = (width - ox + step - 1) / step;
+    int rows = (height - oy + step - 1) / step;
+    float scale = 4.0f / width;
+
+    parallelFor(0, rows, 4, [&](size_t r0, size_t r1) {
+      float values[rowChunk];
+      for (size_t r = r0; r < r1; ++r) {
+        int y = oy + (int)r * step;
+        float py = (float)viewY + (y - height / 2) * scale;
+        for (int c0 = 0; c0 < cols; c0 += rowChunk) {
+          int n = std::min(rowChunk, cols - c0);
+          int x0 = ox + c0 * step;
+          juliaRowFloat(values, n, (float)viewX + (x0 - width / 2) * scale,
+                        step * scale, py, (float)cx, (float)cy, maxIter);
+          for (int k = 0; k < n; ++k) {
+            uint32_t col = values[k] < 0.0f
+                               ? Palette::rgba(0, 0, 0)
+                               : palette.at((int)(values[k] * colorScale));
+            int x = x0 + k * step;
+            if (fill)
+              fillBlock(x - ox, y - oy, col);
+            else
+              pixels[(size_t)y * width + x] = col;
+          }
+        }
+      }
+    });
+
+    frame++;
+    lastSamples = (size_t)rows * cols;
+    lastMs = double(SDL_GetPerformanceCounter() - start) * 1000.0 /
+             SDL_GetPerformanceFrequency();
+  }
+
+  const uint32_t *data() const { return pixels.data(); }
+  double frameMs() const { return lastMs; }
+  size_t samples() const { return lastSamples; }
+  int interleave() const { return step; }
+
+  size_t memoryBytes() const { return pixels.capacity() * sizeof(uint32_t); }
+
+private:
+  static constexpr int rowChunk = 256;
+
+  void fillBlock(int x, int y, uint32_t col) {
+    for (int dy = 0; dy < step && y + dy < height; ++dy)
+      for (int dx = 0; dx < step && x + dx < width; ++dx)
+        pixels[(size_t)(y + dy) * width + x + dx] = col;
+  }
+
+  const int step;
+  int width = 0, height = 0;
+  int frame = 0;
+  double lastMs = 0.0;
+  size_t lastSamples = 0;
+  std::vector<uint32_t> pixels;
+};
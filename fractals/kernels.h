@@ -0,0 +1,626 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Inner loops of the fractals, free of SDL and of the update() time
+// slicing, so they can be called and benchmarked on their own. The fractal
+// classes own the state and the drawing; these only do the arithmetic.
+
+struct Point2f {
+  float x, y;
+};
+
+struct Segment2f {
+  Point2f a, b;
+};
+
+// Normalized smooth escape value for an orbit that left the bailout circle
+// after n steps with |z|^2 = r2.
+inline float smoothValue(int n, double r2, int maxIter) {
+  double nu = n + 1.0 - std::log2(0.5 * std::log(r2));
+  float t = float(nu / maxIter);
+  return t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+}
+
+// Smooth value for a degree-d polynomial formula; smoothValue() is the
+// d = 2 case.
+inline float smoothValueDegree(int n, double r2, int maxIter,
+                               double logDegree) {
+  double nu = n + 1.0 - std::log(0.5 * std::log(r2)) / logDegree;
+  float t = float(nu / maxIter);
+  return t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+}
+
+// z^N with the multiplications unrolled at compile time by squaring.
+template <int N> inline void complexPow(double x, double y, double &ox,
+                                        double &oy) {
+  static_assert(N >= 1, "power must be positive");
+  if constexpr (N == 1) {
+    ox = x;
+    oy = y;
+  } else if constexpr (N % 2 == 0) {
+    double hx, hy;
+    complexPow<N / 2>(x, y, hx, hy);
+    ox = hx * hx - hy * hy;
+    oy = 2.0 * hx * hy;
+  } else {
+    double hx, hy;
+    complexPow<N - 1>(x, y, hx, hy);
+    ox = hx * x - hy * y;
+    oy = hx * y + hy * x;
+  }
+}
+
+// Escape-time formula policies. step() is one iteration, done() the stop
+// test (escape or, for Newton, convergence) and value() the normalized
+// smooth value in [0, 1] at the step the orbit stopped. The kernels below
+// take the policy as a template parameter, so each formula gets its own
+// inner loop with nothing dispatched at run time.
+
+// z^2 + c: Mandelbrot and Julia.
+struct QuadraticFormula {
+  static void step(double &x, double &y, double cx, double cy) {
+    double nx = x * x - y * y + cx;
+    y = 2.0 * x * y + cy;
+    x = nx;
+  }
+  static bool done(double x, double y) { return x * x + y * y > 4.0; }
+  static float value(int n, double x, double y, int maxIter) {
+    return smoothValue(n, x * x + y * y, maxIter);
+  }
+};
+
+// (|Re z| + i|Im z|)^2 + c.
+struct BurningShipFormula {
+  static void step(double &x, double &y, double cx, double cy) {
+    double ax = std::fabs(x), ay = std::fabs(y);
+    double nx = ax * ax - ay * ay + cx;
+    y = 2.0 * ax * ay + cy;
+    x = nx;
+  }
+  static bool done(double x, double y) { return x * x + y * y > 4.0; }
+  static float value(int n, double x, double y, int maxIter) {
+    return smoothValue(n, x * x + y * y, maxIter);
+  }
+};
+
+// conj(z)^2 + c.
+struct TricornFormula {
+  static void step(double &x, double &y, double cx, double cy) {
+    double nx = x * x - y * y + cx;
+    y = -2.0 * x * y + cy;
+    x = nx;
+  }
+  static bool done(double x, double y) { return x * x + y * y > 4.0; }
+  static float value(int n, double x, double y, int maxIter) {
+    return smoothValue(n, x * x + y * y, maxIter);
+  }
+};
+
+// z^N + c.
+template <int N> struct MultibrotFormula {
+  static void step(double &x, double &y, double cx, double cy) {
+    double px, py;
+    complexPow<N>(x, y, px, py);
+    x = px + cx;
+    y = py + cy;
+  }
+  static bool done(double x, double y) { return x * x + y * y > 4.0; }
+  static float value(int n, double x, double y, int maxIter) {
+    return smoothValueDegree(n, x * x + y * y, maxIter, std::log((double)N));
+  }
+};
+
+// Newton's method on z^3 - 1, started from the pixel. c is unused. An
+// orbit stops once it is within 1e-3 of a cube root of unity; the value
+// puts each root in its own third of the palette, shaded by the number
+// of steps it took.
+struct NewtonFormula {
+  static constexpr double rootY = 0.8660254037844386;
+
+  static void step(double &x, double &y, double, double) {
+    double x2 = x * x - y * y, y2 = 2.0 * x * y;
+    double nx = x2 * x - y2 * y - 1.0, ny = x2 * y + y2 * x;
+    double dx = 3.0 * x2, dy = 3.0 * y2;
+    double d = dx * dx + dy * dy;
+    x -= (nx * dx + ny * dy) / d;
+    y -= (ny * dx - nx * dy) / d;
+  }
+
+  static int root(double x, double y) {
+    if ((x - 1.0) * (x - 1.0) + y * y < 1e-6)
+      return 0;
+    double d = (x + 0.5) * (x + 0.5);
+    if (d + (y - rootY) * (y - rootY) < 1e-6)
+      return 1;
+    if (d + (y + rootY) * (y + rootY) < 1e-6)
+      return 2;
+    return -1;
+  }
+
+  static bool done(double x, double y) { return root(x, y) >= 0; }
+  static float value(int n, double x, double y, int maxIter) {
+    float shade = std::min(1.0f, (float)n / std::min(maxIter, 32));
+    return (root(x, y) + 0.1f + 0.8f * shade) / 3.0f;
+  }
+};
+
+// Iterates formula F from z with parameter c. Returns the smooth value
+// and stores the step count in n, or returns -1 and stores 0 if the orbit
+// never stops within maxIter steps.
+template <class F>
+inline float escapeSmooth(double zx, double zy, double cx, double cy,
+                          int maxIter, int &n) {
+  for (int i = 1; i <= maxIter; ++i) {
+    F::step(zx, zy, cx, cy);
+    if (F::done(zx, zy)) {
+      n = i;
+      return F::value(i, zx, zy, maxIter);
+    }
+  }
+  n = 0;
+  return -1.0f;
+}
+
+// True for points inside the main cardioid or the period-2 bulb, which
+// never escape.
+inline bool inMainBulbs(double cx, double cy) {
+  double y2 = cy * cy;
+  double q = (cx - 0.25) * (cx - 0.25) + y2;
+  if (q * (q + (cx - 0.25)) <= 0.25 * y2)
+    return true;
+  return (cx + 1.0) * (cx + 1.0) + y2 <= 0.0625;
+}
+
+// Iterates z -> z^2 + c from z = 0 and stores the orbit in orbit as
+// (x, y) pairs, 2 * maxIter doubles at most. Returns the number of steps
+// until the orbit left the bailout circle, the escaping point included,
+// or 0 if it stayed bounded for all maxIter steps.
+inline int traceOrbit(double cx, double cy, int maxIter, double *orbit) {
+  double zx = 0.0, zy = 0.0;
+  for (int i = 0; i < maxIter; ++i) {
+    double nx = zx * zx - zy * zy + cx;
+    zy = 2.0 * zx * zy + cy;
+    zx = nx;
+    orbit[2 * i] = zx;
+    orbit[2 * i + 1] = zy;
+    if (zx * zx + zy * zy > 4.0)
+      return i + 1;
+  }
+  return 0;
+}
+
+// Advances every unfinished pixel of a row by one step of formula F,
+// which is step n of the render. cx holds the real part of c per column.
+// Pixels that stop get their step count and smooth value, and [first,
+// last) is widened to cover them. Returns how many stopped.
+template <class F>
+inline long escapeStepRow(double *zx, double *zy, int *iters, float *smooth,
+                          int count, const double *cx, double cy, int n,
+                          int maxIter, int &first, int &last) {
+  long escaped = 0;
+  for (int x = 0; x < count; ++x) {
+    if (iters[x])
+      continue;
+
+    double px = zx[x], py = zy[x];
+    F::step(px, py, cx[x], cy);
+    zx[x] = px;
+    zy[x] = py;
+
+    if (F::done(px, py)) {
+      iters[x] = n;
+      smooth[x] = F::value(n, px, py, maxIter);
+      first = std::min(first, x);
+      last = x + 1;
+      escaped++;
+    }
+  }
+  return escaped;
+}
+
+// Four floats, or four int masks, per SSE register. juliaRowFloat() uses
+// the compiler's vector extensions because its select-and-freeze loop does
+// not reliably auto-vectorize; with eight independent vectors per batch the
+// loop is also not bound by the latency of one orbit.
+typedef float FloatVec4 __attribute__((vector_size(16)));
+typedef int32_t IntVec4 __attribute__((vector_size(16)));
+
+constexpr int juliaLanes = 32;
+
+// Single-precision z -> z^2 + c for count pixels of one row, starting at
+// z = (x0 + i * dx, y). Stores the unnormalized smooth iteration count of
+// each pixel in out, or -1 if it stays bounded for maxIter steps. Meant
+// for previews that redraw every frame with a new c. A batch of
+// juliaLanes pixels runs until all of them have escaped, with escaped
+// lanes frozen by a mask.
+inline void juliaRowFloat(float *out, int count, float x0, float dx, float y,
+                          float cx, float cy, int maxIter) {
+  constexpr int vecs = juliaLanes / 4;
+
+  for (int b = 0; b < count; b += juliaLanes) {
+    FloatVec4 zx[vecs], zy[vecs];
+    IntVec4 n[vecs];
+    for (int v = 0; v < vecs; ++v) {
+      for (int l = 0; l < 4; ++l)
+        zx[v][l] = x0 + (b + v * 4 + l) * dx;
+      zy[v] = FloatVec4{} + y;
+      n[v] = IntVec4{};
+    }
+
+    for (int i = 0; i < maxIter; ++i) {
+      IntVec4 live{};
+      for (int v = 0; v < vecs; ++v) {
+        FloatVec4 x = zx[v], yy = zy[v];
+        FloatVec4 x2 = x * x, y2 = yy * yy;
+        IntVec4 in = x2 + y2 <= 4.0f;
+        zx[v] = in ? x2 - y2 + cx : x;
+        zy[v] = in ? 2.0f * x * yy + cy : yy;
+        n[v] -= in;
+        live |= in;
+      }
+      if (!(live[0] | live[1] | live[2] | live[3]))
+        break;
+    }
+
+    int m = std::min(juliaLanes, count - b);
+    for (int l = 0; l < m; ++l) {
+      float px = zx[l / 4][l % 4], py = zy[l / 4][l % 4];
+      float r2 = px * px + py * py;
+      out[b + l] = r2 <= 4.0f
+                       ? -1.0f
+                       : n[l / 4][l % 4] + 1.0f -
+                             std::log2(0.5f * std::log(r2));
+    }
+  }
+}
+
+// Replaces each of the n segments with the four segments of one Koch
+// step, writing 4 * n segments to out.
+inline void kochSubdivide(const Segment2f *in, size_t n, Segment2f *out) {
+  const float hcoeff = std::sqrt(3.0f) / 6.0f;
+
+  for (size_t i = 0; i < n; ++i) {
+    const Segment2f &seg = in[i];
+    float dx = seg.b.x - seg.a.x;
+    float dy = seg.b.y - seg.a.y;
+
+    Point2f p1 = seg.a;
+    Point2f p2 = {seg.a.x + dx / 3.0f, seg.a.y + dy / 3.0f};
+    Point2f p4 = {seg.a.x + 2.0f * dx / 3.0f, seg.a.y + 2.0f * dy / 3.0f};
+    Point2f p5 = seg.b;
+
+    Point2f p3 = {(seg.a.x + seg.b.x) * 0.5f + dy * hcoeff,
+                  (seg.a.y + seg.b.y) * 0.5f - dx * hcoeff};
+
+    Segment2f *o = out + 4 * i;
+    o[0] = {p1, p2};
+    o[1] = {p2, p3};
+    o[2] = {p3, p4};
+    o[3] = {p4, p5};
+  }
+}
+
+// Grid position of point d along the Hilbert curve filling an n x n grid.
+inline Point2f hilbertD2xy(int n, int d) {
+  float x = 0.0f, y = 0.0f;
+  int t = d;
+  for (int s = 1; s < n; s <<= 1) {
+    int rx = 1 & (t / 2);
+    int ry = 1 & (t ^ rx);
+    if (ry == 0) {
+      if (rx == 1) {
+        x = (float)s - 1.0f - x;
+        y = (float)s - 1.0f - y;
+      }
+      std::swap(x, y);
+    }
+    x += s * (float)rx;
+    y += s * (float)ry;
+    t /= 4;
+  }
+  return {x, y};
+}
+
+struct PlasmaRect {
+  int x1, y1, x2, y2;
+  float roughness;
+};
+
+// Writes the four quadrants of a to out. Returns false for rectangles too
+// small to split.
+inline bool plasmaQuadrants(const PlasmaRect &a, PlasmaRect out[4]) {
+  if (a.x2 - a.x1 <= 1 && a.y2 - a.y1 <= 1)
+    return false;
+
+  int midX = (a.x1 + a.x2) / 2;
+  int midY = (a.y1 + a.y2) / 2;
+  float nextRough = a.roughness * 0.5f;
+  out[0] = {a.x1, a.y1, midX, midY, nextRough};
+  out[1] = {midX, a.y1, a.x2, midY, nextRough};
+  out[2] = {a.x1, midY, midX, a.y2, nextRough};
+  out[3] = {midX, midY, a.x2, a.y2, nextRough};
+  return true;
+}
+
+// One midpoint-displacement step on a row-major grid. plasmaDisplace()
+// sets the center and the four edge midpoints of a and returns the center
+// value; plasmaStep() also writes the four quadrants to out, and returns
+// false for rectangles too small to split.
+inline float plasmaDisplace(float *grid, int stride, const PlasmaRect &a,
+                            float displacement) {
+  int midX = (a.x1 + a.x2) / 2;
+  int midY = (a.y1 + a.y2) / 2;
+
+  float v1 = grid[a.y1 * stride + a.x1];
+  float v2 = grid[a.y1 * stride + a.x2];
+  float v3 = grid[a.y2 * stride + a.x1];
+  float v4 = grid[a.y2 * stride + a.x2];
+
+  float center = (v1 + v2 + v3 + v4) / 4.0f + displacement * a.roughness;
+
+  grid[midY * stride + midX] = center;
+  grid[a.y1 * stride + midX] = (v1 + v2) / 2.0f;
+  grid[a.y2 * stride + midX] = (v3 + v4) / 2.0f;
+  grid[midY * stride + a.x1] = (v1 + v3) / 2.0f;
+  grid[midY * stride + a.x2] = (v2 + v4) / 2.0f;
+  return center;
+}
+
+inline bool plasmaStep(float *grid, int stride, const PlasmaRect &a,
+                       float displacement, float &center,
+                       PlasmaRect out[4]) {
+  if (!plasmaQuadrants(a, out))
+    return false;
+  center = plasmaDisplace(grid, stride, a, displacement);
+  return true;
+}
+
+struct MengerCube {
+  int x, y, size;
+};
+
+// Splits c into a 3x3 grid, stores the center square in hole and the
+// eight surrounding squares in out. Returns false once c is too small.
+inline bool mengerSubdivide(const MengerCube &c, MengerCube &hole,
+                            MengerCube out[8]) {
+  int ns = c.size / 3;
+  if (ns < 1)
+    return false;
+
+  hole = {c.x + ns, c.y + ns, ns};
+  int k = 0;
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j)
+      if (!(i == 1 && j == 1))
+        out[k++] = {c.x + i * ns, c.y + j * ns, ns};
+  return true;
+}
+
+struct SierpinskiTriangle {
+  float x1, y1, x2, y2, x3, y3;
+  int level;
+};
+
+// Splits t at its edge midpoints into the removed middle triangle and the
+// three corner triangles one level down.
+inline void sierpinskiSubdivide(const SierpinskiTriangle &t,
+                                SierpinskiTriangle &hole,
+                                SierpinskiTriangle out[3]) {
+  float m12x = (t.x1 + t.x2) / 2.0f;
+  float m12y = (t.y1 + t.y2) / 2.0f;
+  float m23x = (t.x2 + t.x3) / 2.0f;
+  float m23y = (t.y2 + t.y3) / 2.0f;
+  float m31x = (t.x3 + t.x1) / 2.0f;
+  float m31y = (t.y3 + t.y1) / 2.0f;
+
+  hole = {m12x, m12y, m23x, m23y, m31x, m31y, 0};
+  out[0] = {t.x1, t.y1, m12x, m12y, m31x, m31y, t.level - 1};
+  out[1] = {m12x, m12y, t.x2, t.y2, m23x, m23y, t.level - 1};
+  out[2] = {m31x, m31y, m23x, m23y, t.x3, t.y3, t.level - 1};
+}
+
+// One breadth-first tree level in structure-of-arrays form: branch end
+// points and unit directions.
+struct TreeNodes {
+  float *ex, *ey, *ux, *uy;
+};
+
+// Grows n parent branches into 2n children of length len, laid out as
+// [left children][right children]. (c, s) is the cosine and sine of the
+// branch spread.
+inline void treeExpandLevel(TreeNodes parent, size_t n, float c, float s,
+                            float len, TreeNodes child) {
+  for (size_t i = 0; i < n; ++i) {
+    float lx = parent.ux[i] * c + parent.uy[i] * s;
+    float ly = parent.uy[i] * c - parent.ux[i] * s;
+    float rx = parent.ux[i] * c - parent.uy[i] * s;
+    float ry = parent.uy[i] * c + parent.ux[i] * s;
+
+    child.ux[i] = lx;
+    child.uy[i] = ly;
+    child.ux[n + i] = rx;
+    child.uy[n + i] = ry;
+    child.ex[i] = parent.ex[i] + len * lx;
+    child.ey[i] = parent.ey[i] + len * ly;
+    child.ex[n + i] = parent.ex[i] + len * rx;
+    child.ey[n + i] = parent.ey[i] + len * ry;
+  }
+}
+
+// Counter-based random numbers: the value depends only on (key, counter),
+// so any stream position can be computed directly and lanes of a batch
+// need no shared state.
+inline uint64_t counterHash(uint64_t key, uint64_t counter) {
+  uint64_t z = key + counter * 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// Uniform float in [0, 1) from the top 24 bits of counterHash.
+inline float counterUniform(uint64_t key, uint64_t counter) {
+  return (float)(counterHash(key, counter) >> 40) * (1.0f / 16777216.0f);
+}
+
+// One transform of an iterated function system: an affine map followed by
+// a weighted sum of nonlinear variations, as in fractal flames.
+struct FlameXform {
+  float a, b, c, d, e, f; // x' = a x + b y + c, y' = d x + e y + f
+  float linear, sinusoidal, spherical, swirl, horseshoe;
+  float color; // palette coordinate the point's color moves toward
+};
+
+enum FlameVariation : unsigned {
+  FLAME_LINEAR = 1,
+  FLAME_SINUSOIDAL = 2,
+  FLAME_SPHERICAL = 4,
+  FLAME_SWIRL = 8,
+  FLAME_HORSESHOE = 16,
+};
+
+constexpr int flameLanes = 16;
+
+// Advances flameLanes points one chaos-game step. Each lane picks a
+// transform from the cumulative weights cum (nx entries, last one 1) with
+// random number counter + lane. Every loop runs over all lanes with no
+// data-dependent branches so it vectorizes; variations no transform uses
+// (per the `used` mask) are skipped as a whole.
+inline void flameStep(float *x, float *y, float *col, const FlameXform *xf,
+                      const float *cum, int nx, unsigned used, uint64_t key,
+                      uint64_t counter) {
+  int sel[flameLanes];
+  for (int l = 0; l < flameLanes; ++l) {
+    float u = counterUniform(key, counter + l);
+    int j = 0;
+    for (int k = 0; k + 1 < nx; ++k)
+      j += u >= cum[k];
+    sel[l] = j;
+  }
+
+  float tx[flameLanes], ty[flameLanes], ox[flameLanes], oy[flameLanes];
+  for (int l = 0; l < flameLanes; ++l) {
+    const FlameXform &t = xf[sel[l]];
+    tx[l] = t.a * x[l] + t.b * y[l] + t.c;
+    ty[l] = t.d * x[l] + t.e * y[l] + t.f;
+    ox[l] = 0.0f;
+    oy[l] = 0.0f;
+  }
+
+  if (used & FLAME_LINEAR) {
+    for (int l = 0; l < flameLanes; ++l) {
+      float w = xf[sel[l]].linear;
+      ox[l] += w * tx[l];
+      oy[l] += w * ty[l];
+    }
+  }
+  if (used & FLAME_SINUSOIDAL) {
+    for (int l = 0; l < flameLanes; ++l) {
+      float w = xf[sel[l]].sinusoidal;
+      ox[l] += w * std::sin(tx[l]);
+      oy[l] += w * std::sin(ty[l]);
+    }
+  }
+  if (used & FLAME_SPHERICAL) {
+    for (int l = 0; l < flameLanes; ++l) {
+      float w = xf[sel[l]].spherical /
+                (tx[l] * tx[l] + ty[l] * ty[l] + 1e-6f);
+      ox[l] += w * tx[l];
+      oy[l] += w * ty[l];
+    }
+  }
+  if (used & FLAME_SWIRL) {
+    for (int l = 0; l < flameLanes; ++l) {
+      float r2 = tx[l] * tx[l] + ty[l] * ty[l];
+      float s = std::sin(r2), c = std::cos(r2);
+      float w = xf[sel[l]].swirl;
+      ox[l] += w * (tx[l] * s - ty[l] * c);
+      oy[l] += w * (tx[l] * c + ty[l] * s);
+    }
+  }
+  if (used & FLAME_HORSESHOE) {
+    for (int l = 0; l < flameLanes; ++l) {
+      float w = xf[sel[l]].horseshoe /
+                (std::sqrt(tx[l] * tx[l] + ty[l] * ty[l]) + 1e-6f);
+      ox[l] += w * (tx[l] - ty[l]) * (tx[l] + ty[l]);
+      oy[l] += w * 2.0f * tx[l] * ty[l];
+    }
+  }
+
+  for (int l = 0; l < flameLanes; ++l) {
+    x[l] = ox[l];
+    y[l] = oy[l];
+    col[l] = 0.5f * (col[l] + xf[sel[l]].color);
+  }
+}
+
+// Blends color c over pixel p, both RGBA8888, with coverage a in [0, 256].
+// Red/blue and green/alpha are each blended as two 16-bit lanes of one
+// multiply.
+inline void blendPixel(uint32_t &p, uint32_t c, uint32_t a) {
+  uint32_t rb = ((p >> 8) & 0x00FF00FFu) * (256 - a) +
+                ((c >> 8) & 0x00FF00FFu) * a;
+  uint32_t ga = (p & 0x00FF00FFu) * (256 - a) + (c & 0x00FF00FFu) * a;
+  p = (rb & 0xFF00FF00u) | ((ga >> 8) & 0x00FF00FFu);
+}
+
+// Draws the segment (x0, y0)-(x1, y1) with Xiaolin Wu's anti-aliasing,
+// blending color into a buffer with the given row stride. Pixel (i, j)
+// covers [i, i + 1) x [j, j + 1); the end columns are weighted by how much
+// of them the segment covers, and a segment within one column, even a
+// zero-length one, draws it fully. Only pixels inside [cx0, cx1) x
+// [cy0, cy1) are touched and only the columns (or rows, for steep
+// segments) in it are walked, so a buffer can be drawn in tiles from
+// several threads.
+inline void wuLine(uint32_t *pixels, int stride, float x0, float y0, float x1,
+                   float y1, uint32_t color, int cx0, int cy0, int cx1,
+                   int cy1) {
+  x0 -= 0.5f;
+  y0 -= 0.5f;
+  x1 -= 0.5f;
+  y1 -= 0.5f;
+
+  bool steep = std::fabs(y1 - y0) > std::fabs(x1 - x0);
+  if (steep) {
+    std::swap(x0, y0);
+    std::swap(x1, y1);
+    std::swap(cx0, cy0);
+    std::swap(cx1, cy1);
+  }
+  if (x0 > x1) {
+    std::swap(x0, x1);
+    std::swap(y0, y1);
+  }
+
+  float dx = x1 - x0;
+  float g = dx > 0.0f ? (y1 - y0) / dx : 0.0f;
+  int xs = (int)std::floor(x0 + 0.5f), xe = (int)std::floor(x1 + 0.5f);
+  int first = std::max(xs, cx0), last = std::min(xe, cx1 - 1);
+
+  for (int x = first; x <= last; ++x) {
+    float cover = 1.0f;
+    if (xs == xe)
+      cover = 1.0f;
+    else if (x == xs)
+      cover = xs + 0.5f - x0;
+    else if (x == xe)
+      cover = x1 - (xe - 0.5f);
+
+    float y = y0 + g * (x - x0);
+    int iy = (int)std::floor(y);
+    float f = y - iy;
+    uint32_t a[2] = {(uint32_t)((1.0f - f) * cover * 256.0f),
+                     (uint32_t)(f * cover * 256.0f)};
+
+    for (int k = 0; k < 2; ++k) {
+      int m = iy + k;
+      if (m < cy0 || m >= cy1 || a[k] == 0)
+        continue;
+      size_t idx = steep ? (size_t)x * stride + m : (size_t)m * stride + x;
+      blendPixel(pixels[idx], color, a[k]);
+    }
+  }
+}
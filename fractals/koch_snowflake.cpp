@@ -1,29 +1,20 @@
-#include "fractal.h"
+#include "budget.h"
+#include "kernels.h"
+#include "line_raster.h"
+#include "subdivision.h"
+#include <algorithm>
 #include <cmath>
 #include <vector>
 
-class Koch : public FractalFB {
+class Koch : public LineFractal {
 public:
-  Koch(SDL_Renderer *r) : FractalFB(r) {}
+  Koch(SDL_Renderer *r) : LineFractal(r) {}
 
-  struct Point {
-    float x, y;
-  };
-
-  struct Segment {
-    Point a, b;
-  };
+  using Point = Point2f;
+  using Segment = Segment2f;
 
   void reset() override {
-    if (texture) {
-      SDL_DestroyTexture(texture);
-      texture = nullptr;
-    }
-
-    segs.clear();
-    step = 0;
-    accum = 0.0f;
-    finished = false;
+    clearCanvas();
 
     float side = std::min(width, height) * 0.6f;
     float h = side * std::sqrt(3.0f) / 2.0f;
@@ -34,94 +25,65 @@ public:
     Point left = {centerX - side * 0.5f, centerY + h * 0.5f};
     Point right = {centerX + side * 0.5f, centerY + h * 0.5f};
 
-    segs.push_back({top, right});
-    segs.push_back({right, left});
-    segs.push_back({left, top});
-
-    redraw();
+    Segment sides[] = {{top, right}, {right, left}, {left, top}};
+    segments.reset(sides, 3);
+    for (const auto &seg : sides)
+      drawLine(seg.a.x, seg.a.y, seg.b.x, seg.b.y, color);
+    flushLines();
+    back.assign(pixels.size(), Palette::rgba(0, 0, 0));
   }
 
+  // Processing a segment draws the four it is replaced by into the back
+  // canvas. The canvases are swapped and uploaded once a level is fully
+  // drawn.
   bool update(float dt, uint32_t maxMs) override {
-    if (finished)
+    if (segments.done())
       return false;
 
-    accum += dt;
-    if (accum < 0.8f)
-      return true;
-
-    accum = 0.0f;
-    if (step < 8) {
-      subdivide();
-      step++;
-      redraw();
-    } else {
-      finished = true;
-    }
+    FrameBudget budget(maxMs);
+    bool more = segments.step(
+        dt, budget,
+        [](const Segment &s, Segment *out) {
+          kochSubdivide(&s, 1, out);
+          return 4;
+        },
+        [&](const Segment *, size_t n, const Segment *parts,
+            const unsigned char *) {
+          for (size_t i = 0; i < 4 * n; ++i)
+            drawLine(parts[i].a.x, parts[i].a.y, parts[i].b.x, parts[i].b.y,
+                     color);
+          raster.flush(back.data(), [](int, int, int) {});
+          counters.iterations += n;
+        },
+        [](const Segment &) { return true; },
+        [&] {
+          pixels.swap(back);
+          markAllDirty();
+          uploadDirty(pixels.data());
+          std::fill(back.begin(), back.end(), Palette::rgba(0, 0, 0));
+          return true;
+        });
+    return more;
+  }
 
-    return !finished;
+  size_t memoryBytes() const override {
+    return LineFractal::memoryBytes() + back.capacity() * sizeof(uint32_t) +
+           segments.memoryBytes();
   }
 
-  void render() override {
-    if (texture) {
-      SDL_RenderCopy(renderer, texture, nullptr, nullptr);
-    }
+  FractalMetrics metrics() const override {
+    FractalMetrics m = LineFractal::metrics();
+    m.queued = segments.queued();
+    return m;
   }
 
   const char *getName() const override { return "Koch Snowflake"; }
 
 private:
-  void subdivide() {
-    std::vector<Segment> next;
-    next.reserve(segs.size() * 4);
-
-    float hcoeff = std::sqrt(3.0f) / 6.0f;
-
-    for (const auto &seg : segs) {
-      float dx = seg.b.x - seg.a.x;
-      float dy = seg.b.y - seg.a.y;
-
-      Point p1 = seg.a;
-      Point p2 = {seg.a.x + dx / 3.0f, seg.a.y + dy / 3.0f};
-      Point p4 = {seg.a.x + 2.0f * dx / 3.0f, seg.a.y + 2.0f * dy / 3.0f};
-      Point p5 = seg.b;
-
-      Point p3 = {(seg.a.x + seg.b.x) * 0.5f + dy * hcoeff,
-                  (seg.a.y + seg.b.y) * 0.5f - dx * hcoeff};
-
-      next.push_back({p1, p2});
-      next.push_back({p2, p3});
-      next.push_back({p3, p4});
-      next.push_back({p4, p5});
-    }
-
-    segs = std::move(next);
-  }
-
-  void redraw() {
-    if (texture)
-      SDL_DestroyTexture(texture);
-
-    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
-                                SDL_TEXTUREACCESS_TARGET, width, height);
-
-    if (!texture)
-      return;
-
-    SDL_SetRenderTarget(renderer, texture);
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
-
-    SDL_SetRenderDrawColor(renderer, 220, 240, 255, 255);
-    for (const auto &seg : segs) {
-      SDL_RenderDrawLineF(renderer, seg.a.x, seg.a.y, seg.b.x, seg.b.y);
-    }
-
-    SDL_SetRenderTarget(renderer, nullptr);
-  }
+  static constexpr int steps = 8;
+  static constexpr uint32_t color = Palette::rgba(220, 240, 255);
 
-  std::vector<Segment> segs;
-  float accum = 0.0f;
-  int step = 0;
-  bool finished = false;
-  SDL_Texture *texture = nullptr;
-};
\ No newline at end of file
+  Subdivision<Segment, 4> segments{SubdivisionPace::LEVELS, 1.25f,
+                                   &counters.allocations, steps};
+  std::vector<uint32_t> back;
+};
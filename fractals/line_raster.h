@@ -0,0 +1,220 @@
+#pragma once
+#include "fractal.h"
+#include "kernels.h"
+#include "palette.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Software rasterizer for the line-based fractals. Segments are queued
+// with add() and drawn by flush() into a caller-owned RGBA8888 buffer with
+// wuLine(). flush() first bins the queue into tileSize x tileSize screen
+// tiles, each pool task binning a contiguous slice of it into bins of its
+// own, and then draws the tiles in parallel, every tile clipped to itself
+// and owned by one task. Within a tile segments are drawn in the order they
+// were added, so the result does not depend on the number of threads.
+class LineRaster {
+public:
+  static constexpr int tileSize = 64;
+
+  void resize(int w, int h) {
+    width = w;
+    height = h;
+    tilesX = (w + tileSize - 1) / tileSize;
+    tilesY = (h + tileSize - 1) / tileSize;
+    segs.clear();
+    bins.assign((size_t)ThreadPool::instance().workers() * tiles(), {});
+    touched.assign(tiles(), 0);
+  }
+
+  void add(float x0, float y0, float x1, float y1, uint32_t color) {
+    segs.push_back({x0, y0, x1, y1, color});
+  }
+
+  // A one-pixel dot centered on (x, y).
+  void addPoint(float x, float y, uint32_t color) {
+    add(x - 0.5f, y, x + 0.5f, y, color);
+  }
+
+  bool hasSize(int w, int h) const { return width == w && height == h; }
+  size_t pending() const { return segs.size(); }
+  uint64_t drawn() const { return drawnCount; }
+
+  void discard() { segs.clear(); }
+
+  // Draws and drops every queued segment. mark(y, x0, x1) is then called
+  // for each row of every tile that was drawn into.
+  template <class Mark> void flush(uint32_t *pixels, Mark &&mark) {
+    if (segs.empty())
+      return;
+
+    size_t n = segs.size();
+    int tasks = (int)std::min<size_t>(ThreadPool::instance().workers(),
+                                      (n + binGrain - 1) / binGrain);
+    size_t chunk = (n + tasks - 1) / tasks;
+
+    ThreadPool::instance().run(tasks, [&](int t) {
+      std::vector<uint32_t> *out = &bins[(size_t)t * tiles()];
+      size_t hi = std::min(n, (t + 1) * chunk);
+      for (size_t i = t * chunk; i < hi; ++i)
+        bin(segs[i], (uint32_t)i, out);
+    });
+
+    parallelFor(0, tiles(), 1, [&](size_t lo, size_t hi) {
+      for (size_t tile = lo; tile < hi; ++tile) {
+        int cx0 = (int)(tile % tilesX) * tileSize;
+        int cy0 = (int)(tile / tilesX) * tileSize;
+        int cx1 = std::min(width, cx0 + tileSize);
+        int cy1 = std::min(height, cy0 + tileSize);
+
+        for (int t = 0; t < tasks; ++t) {
+          std::vector<uint32_t> &b = bins[(size_t)t * tiles() + tile];
+          for (uint32_t id : b) {
+            const Segment &s = segs[id];
+            wuLine(pixels, width, s.x0, s.y0, s.x1, s.y1, s.color, cx0, cy0,
+                   cx1, cy1);
+          }
+          touched[tile] |= !b.empty();
+          b.clear();
+        }
+      }
+    });
+
+    for (size_t tile = 0; tile < tiles(); ++tile) {
+      if (!touched[tile])
+        continue;
+      touched[tile] = 0;
+      int x0 = (int)(tile % tilesX) * tileSize;
+      int y0 = (int)(tile / tilesX) * tileSize;
+      int x1 = std::min(width, x0 + tileSize);
+      int y1 = std::min(height, y0 + tileSize);
+      for (int y = y0; y < y1; ++y)
+        mark(y, x0, x1);
+    }
+    drawnCount += segs.size();
+    segs.clear();
+  }
+
+  size_t memoryBytes() const {
+    size_t bytes = segs.capacity() * sizeof(Segment) + touched.capacity();
+    for (const auto &b : bins)
+      bytes += b.capacity() * sizeof(uint32_t);
+    return bytes;
+  }
+
+private:
+  struct Segment {
+    float x0, y0, x1, y1;
+    uint32_t color;
+  };
+
+  static constexpr size_t binGrain = 4096;
+
+  size_t tiles() const { return (size_t)tilesX * tilesY; }
+
+  // Tile index of coordinate v, clamped to [-1, count] so far off-screen
+  // (or NaN) coordinates cannot overflow.
+  static int tileOf(float v, int count) {
+    float t = std::floor(v / tileSize);
+    return !(t >= 0.0f) ? -1 : (t > count ? count : (int)t);
+  }
+
+  // Adds id to every tile the segment can touch: for each band of tile
+  // rows it crosses, the tiles spanned by its part within that band. Wu
+  // lines reach at most a pixel beyond the segment, hence the margins.
+  void bin(const Segment &s, uint32_t id, std::vector<uint32_t> *out) const {
+    float ymin = std::min(s.y0, s.y1) - 1.0f;
+    float ymax = std::max(s.y0, s.y1) + 1.0f;
+    int ty0 = std::max(0, tileOf(ymin, tilesY));
+    int ty1 = std::min(tilesY - 1, tileOf(ymax, tilesY));
+    float dx = s.x1 - s.x0, dy = s.y1 - s.y0;
+
+    for (int ty = ty0; ty <= ty1; ++ty) {
+      float xa = std::min(s.x0, s.x1), xb = std::max(s.x0, s.x1);
+      if (std::fabs(dy) > 1e-6f) {
+        float t0 = (ty * tileSize - 1.0f - s.y0) / dy;
+        float t1 = ((ty + 1) * tileSize + 1.0f - s.y0) / dy;
+        if (t0 > t1)
+          std::swap(t0, t1);
+        t0 = std::max(t0, 0.0f);
+        t1 = std::min(t1, 1.0f);
+        if (t0 > t1)
+          continue;
+        xa = s.x0 + dx * t0;
+        xb = s.x0 + dx * t1;
+        if (xa > xb)
+          std::swap(xa, xb);
+      }
+
+      int tx0 = std::max(0, tileOf(xa - 1.0f, tilesX));
+      int tx1 = std::min(tilesX - 1, tileOf(xb + 1.0f, tilesX));
+      for (int tx = tx0; tx <= tx1; ++tx)
+        out[(size_t)ty * tilesX + tx].push_back(id);
+    }
+  }
+
+  int width = 0, height = 0;
+  int tilesX = 0, tilesY = 0;
+  uint64_t drawnCount = 0;
+  std::vector<Segment> segs;
+  std::vector<std::vector<uint32_t>> bins;
+  std::vector<uint8_t> touched;
+};
+
+// Base for fractals drawn as lines: a CPU canvas that the queued lines are
+// rasterized into, with only the touched tiles uploaded to the texture.
+class LineFractal : public FractalFB {
+public:
+  explicit LineFractal(SDL_Renderer *r) : FractalFB(r) {}
+
+  size_t memoryBytes() const override {
+    return FractalFB::memoryBytes() + pixels.capacity() * sizeof(uint32_t) +
+           raster.memoryBytes();
+  }
+
+  FractalMetrics metrics() const override {
+    FractalMetrics m = counters;
+    m.primitives += raster.drawn();
+    return m;
+  }
+
+protected:
+  // Blacks out the canvas at the current size and drops queued lines; the
+  // whole canvas is uploaded on the next flushLines().
+  void clearCanvas() {
+    if (!raster.hasSize(width, height)) {
+      pixels.assign((size_t)width * height, Palette::rgba(0, 0, 0));
+      raster.resize(width, height);
+    } else {
+      std::fill(pixels.begin(), pixels.end(), Palette::rgba(0, 0, 0));
+      raster.discard();
+    }
+    markAllDirty();
+  }
+
+  void drawLine(float x0, float y0, float x1, float y1, uint32_t color) {
+    raster.add(x0, y0, x1, y1, color);
+  }
+
+  void drawPoint(float x, float y, uint32_t color) {
+    raster.addPoint(x, y, color);
+  }
+
+  // Rasterizes the queued lines into the canvas, marking what they touched.
+  void rasterizeLines() {
+    raster.flush(pixels.data(),
+                 [&](int y, int x0, int x1) { markDirty(y, x0, x1); });
+  }
+
+  // Rasterizes the queued lines and uploads everything changed since the
+  // last upload.
+  void flushLines() {
+    rasterizeLines();
+    uploadDirty(pixels.data());
+  }
+
+  std::vector<uint32_t> pixels;
+  LineRaster raster;
+};
@@ -1,63 +1,92 @@
-#include "fractal.h"
+#include "escape_time.h"
+#include "julia_preview.h"
 
-class Mandelbrot : public FractalFB {
+// While the pointer is over the view, a picture-in-picture shows the Julia
+// set for the c under it (toggled with J). The inset sits in the top
+// corner away from the pointer.
+class Mandelbrot : public EscapeTimeFractal<QuadraticFormula> {
 public:
-  Mandelbrot(SDL_Renderer *r) : FractalFB(r) {}
+  Mandelbrot(SDL_Renderer *r)
+      : EscapeTimeFractal(r, 256, 100.0f, Palette::Preset::GRAY, 1.0f) {}
 
-  void reset() override {
-    iter = 1;
-    iterAcc = 0.0f;
-    clear();
+  ~Mandelbrot() override {
+    if (inset)
+      SDL_DestroyTexture(inset);
   }
 
   bool update(float dt, uint32_t maxMs) override {
-    if (iter > 256)
-      return false;
+    bool busy = EscapeTimeFractal::update(dt, maxMs);
+    if (!hovering || !insetDirty)
+      return busy;
 
-    uint32_t start = SDL_GetTicks();
-    SDL_SetRenderTarget(renderer, texture);
-
-    iterAcc += dt * 100.0f;
-
-    while (iterAcc >= 1.0f && iter <= 256) {
+    int w = std::max(1, width / insetDivisor);
+    int h = std::max(1, height / insetDivisor);
+    if (!inset || w != insetW || h != insetH) {
+      if (inset)
+        SDL_DestroyTexture(inset);
+      inset = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+                                SDL_TEXTUREACCESS_STREAMING, w, h);
+      insetW = w;
+      insetH = h;
+    }
 
-      if (SDL_GetTicks() - start >= maxMs)
-        break;
+    preview.render(w, h, planeX(pointerX), planeY(pointerY), palette,
+                   density * Palette::size / maxIter);
+    SDL_UpdateTexture(inset, nullptr, preview.data(), w * 4);
+    insetDirty = false;
+    return true;
+  }
 
-      for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-          double cx = (x - width / 2.0) * 4.0 / width;
-          double cy = (y - height / 2.0) * 4.0 / width;
+  void render() override {
+    FractalFB::render();
+    if (!hovering || !showInset || !inset)
+      return;
 
-          double zx = 0.0, zy = 0.0;
-          int i = 0;
+    int ow, oh;
+    SDL_GetRendererOutputSize(renderer, &ow, &oh);
+    SDL_Rect dst;
+    dst.w = ow / insetDivisor;
+    dst.h = dst.w * insetH / insetW;
+    dst.x = pointerX < width / 2 ? ow - dst.w - insetMargin : insetMargin;
+    dst.y = insetMargin;
 
-          while (zx * zx + zy * zy < 4.0 && i < iter) {
-            double t = zx * zx - zy * zy + cx;
-            zy = 2 * zx * zy + cy;
-            zx = t;
-            ++i;
-          }
+    SDL_RenderCopy(renderer, inset, nullptr, &dst);
+    SDL_SetRenderDrawColor(renderer, 100, 150, 220, 255);
+    SDL_RenderDrawRect(renderer, &dst);
+  }
 
-          if (zx * zx + zy * zy >= 4.0 && i == iter) {
-            Uint8 c = Uint8(255 * iter / 256.0);
-            SDL_SetRenderDrawColor(renderer, c, c, c, 255);
-            SDL_RenderDrawPoint(renderer, x, y);
-          }
-        }
-      }
+  void setPointer(bool inside, int x, int y) override {
+    bool show = inside && showInset;
+    insetDirty = show && (!hovering || x != pointerX || y != pointerY);
+    hovering = show;
+    pointerX = x;
+    pointerY = y;
+  }
 
-      iter++;
-      iterAcc -= 1.0f;
-    }
+  bool handleKey(SDL_Keycode key) override {
+    if (key != SDLK_j)
+      return EscapeTimeFractal::handleKey(key);
+    showInset = !showInset;
+    hovering = hovering && showInset;
+    return true;
+  }
 
-    SDL_SetRenderTarget(renderer, nullptr);
-    return iter <= 256;
+  size_t memoryBytes() const override {
+    return EscapeTimeFractal::memoryBytes() + preview.memoryBytes() +
+           (size_t)insetW * insetH * 4;
   }
 
   const char *getName() const override { return "Mandelbrot"; }
 
 private:
-  int iter = 1;
-  float iterAcc = 0.0f;
+  static constexpr int insetDivisor = 4;
+  static constexpr int insetMargin = 12;
+
+  JuliaPreview preview{1};
+  SDL_Texture *inset = nullptr;
+  int insetW = 0, insetH = 0;
+  int pointerX = 0, pointerY = 0;
+  bool hovering = false;
+  bool insetDirty = false;
+  bool showInset = true;
 };
@@ -1,14 +1,14 @@
+#include "budget.h"
 #include "fractal.h"
+#include "kernels.h"
+#include "subdivision.h"
 #include <algorithm>
-#include <vector>
 
 class Menger : public FractalFB {
 public:
   Menger(SDL_Renderer *r) : FractalFB(r) {}
 
-  struct Cube {
-    int x, y, size;
-  };
+  using Cube = MengerCube;
 
   void reset() override {
     clear();
@@ -22,67 +22,53 @@ public:
     SDL_Rect mainRect{x, y, s, s};
     SDL_RenderFillRect(renderer, &mainRect);
 
-    currentLevelCubes.clear();
-    nextLevelCubes.clear();
-
-    currentLevelCubes.push_back({x, y, s});
-
-    level = 0;
-    accSteps = 0.0f;
-    done = false;
+    cubes.reset({x, y, s});
     SDL_SetRenderTarget(renderer, nullptr);
   }
 
   bool update(float dt, uint32_t maxMs) override {
-    if (done) {
+    if (cubes.done()) {
       drawToScreen();
       return false;
     }
 
-    uint32_t start = SDL_GetTicks();
+    FrameBudget budget(maxMs);
     SDL_SetRenderTarget(renderer, texture);
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
 
-    accSteps += dt * 40.0f;
-
-    while (accSteps >= 1.0f) {
-      if (SDL_GetTicks() - start >= maxMs)
-        break;
-
-      if (currentLevelCubes.empty()) {
-
-        if (nextLevelCubes.empty() || level >= MAX_LEVEL) {
-          done = true;
-          break;
-        }
-        currentLevelCubes = std::move(nextLevelCubes);
-        nextLevelCubes.clear();
-        level++;
-      }
-
-      Cube c = currentLevelCubes.back();
-      currentLevelCubes.pop_back();
-
-      int ns = c.size / 3;
-      if (ns >= 1) {
-
-        SDL_Rect hole{c.x + ns, c.y + ns, ns, ns};
-        SDL_RenderFillRect(renderer, &hole);
-
-        for (int i = 0; i < 3; ++i) {
-          for (int j = 0; j < 3; ++j) {
-            if (!(i == 1 && j == 1)) {
-              nextLevelCubes.push_back({c.x + i * ns, c.y + j * ns, ns});
-            }
+    cubes.step(
+        dt, budget,
+        [](const Cube &c, Cube *out) {
+          Cube hole;
+          return mengerSubdivide(c, hole, out) ? 8 : 0;
+        },
+        [&](const Cube *, size_t n, const Cube *parts,
+            const unsigned char *counts) {
+          // The hole is diagonally next to the first child.
+          for (size_t i = 0; i < n; ++i) {
+            if (!counts[i])
+              continue;
+            const Cube &c = parts[8 * i];
+            SDL_Rect r{c.x + c.size, c.y + c.size, c.size, c.size};
+            SDL_RenderFillRect(renderer, &r);
+            counters.primitives++;
           }
-        }
-      }
-      accSteps -= 1.0f;
-    }
+          counters.iterations += n;
+        });
 
     SDL_SetRenderTarget(renderer, nullptr);
     drawToScreen();
-    return !done;
+    return !cubes.done();
+  }
+
+  size_t memoryBytes() const override {
+    return FractalFB::memoryBytes() + cubes.memoryBytes();
+  }
+
+  FractalMetrics metrics() const override {
+    FractalMetrics m = counters;
+    m.queued = cubes.queued();
+    return m;
   }
 
   const char *getName() const override { return "Menger"; }
@@ -95,10 +81,7 @@ private:
     SDL_RenderCopy(renderer, texture, nullptr, nullptr);
   }
 
-  std::vector<Cube> currentLevelCubes;
-  std::vector<Cube> nextLevelCubes;
-  float accSteps = 0.0f;
-  int level = 0;
   static constexpr int MAX_LEVEL = 10;
-  bool done = false;
+  Subdivision<Cube, 8> cubes{SubdivisionPace::ITEMS, 40.0f,
+                             &counters.allocations, MAX_LEVEL};
 };
\ No newline at end of file
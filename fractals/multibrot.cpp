@@ -0,0 +1,9 @@
+#include "escape_time.h"
+
+class Multibrot : public EscapeTimeFractal<MultibrotFormula<3>> {
+public:
+  Multibrot(SDL_Renderer *r)
+      : EscapeTimeFractal(r, 256, 100.0f, Palette::Preset::CLASSIC, 4.0f) {}
+
+  const char *getName() const override { return "Multibrot z^3"; }
+};
@@ -0,0 +1,13 @@
+#include "escape_time.h"
+
+// Basins of attraction of Newton's method on z^3 - 1, one third of the
+// palette per root.
+class Newton : public EscapeTimeFractal<NewtonFormula> {
+public:
+  Newton(SDL_Renderer *r)
+      : EscapeTimeFractal(r, 64, 30.0f, Palette::Preset::CLASSIC, 1.0f) {
+    juliaSet = true;
+  }
+
+  const char *getName() const override { return "Newton"; }
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Precomputed cyclic color lookup table in SDL_PIXELFORMAT_RGBA8888 order.
+class Palette {
+public:
+  static constexpr int size = 1024;
+
+  enum class Preset { GRAY, CLASSIC, FIRE, OCEAN, COUNT };
+
+  explicit Palette(Preset p = Preset::CLASSIC) { build(p); }
+
+  void build(Preset p) {
+    preset = p;
+    switch (p) {
+    case Preset::GRAY:
+      fill({{0.0f, 0, 0, 0}, {1.0f, 255, 255, 255}});
+      break;
+    case Preset::CLASSIC:
+      fill({{0.0f, 0, 7, 100},
+            {0.16f, 32, 107, 203},
+            {0.42f, 237, 255, 255},
+            {0.64f, 255, 170, 0},
+            {0.86f, 0, 2, 0},
+            {1.0f, 0, 7, 100}});
+      break;
+    case Preset::FIRE:
+      fill({{0.0f, 0, 0, 0},
+            {0.3f, 180, 20, 0},
+            {0.6f, 255, 170, 20},
+            {0.8f, 255, 255, 200},
+            {1.0f, 0, 0, 0}});
+      break;
+    case Preset::OCEAN:
+      fill({{0.0f, 0, 10, 30},
+            {0.35f, 0, 90, 140},
+            {0.65f, 120, 220, 210},
+            {1.0f, 0, 10, 30}});
+      break;
+    default:
+      break;
+    }
+  }
+
+  void next() {
+    build(Preset(((int)preset + 1) % (int)Preset::COUNT));
+  }
+
+  uint32_t at(int i) const { return lut[i & (size - 1)]; }
+
+  const char *getName() const {
+    static const char *names[] = {"Gray", "Classic", "Fire", "Ocean"};
+    return names[(int)preset];
+  }
+
+  static constexpr uint32_t rgba(uint8_t r, uint8_t g, uint8_t b) {
+    return (uint32_t)r << 24 | (uint32_t)g << 16 | (uint32_t)b << 8 | 0xFFu;
+  }
+
+private:
+  struct Stop {
+    float pos;
+    uint8_t r, g, b;
+  };
+
+  void fill(const std::vector<Stop> &stops) {
+    size_t s = 0;
+    for (int i = 0; i < size; ++i) {
+      float t = (float)i / size;
+      while (s + 2 < stops.size() && t > stops[s + 1].pos)
+        s++;
+      const Stop &a = stops[s];
+      const Stop &b = stops[s + 1];
+      float f = (t - a.pos) / (b.pos - a.pos);
+      f = f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+      lut[i] = rgba(uint8_t(a.r + (b.r - a.r) * f),
+                    uint8_t(a.g + (b.g - a.g) * f),
+                    uint8_t(a.b + (b.b - a.b) * f));
+    }
+  }
+
+  Preset preset = Preset::CLASSIC;
+  uint32_t lut[size];
+};
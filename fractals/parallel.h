@@ -0,0 +1,151 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker pool shared by all fractals. The calling thread takes
+// part in the work, and nested or concurrent calls fall back to running
+// serially on the caller instead of blocking.
+class ThreadPool {
+public:
+  static ThreadPool &instance() {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  int workers() const { return (int)threads.size() + 1; }
+
+  // How many workers can keep a private buffer of bytesPerWorker each
+  // within privateBufferBytes in total, at least one.
+  int workersFor(size_t bytesPerWorker) const {
+    size_t fit = privateBufferBytes / std::max<size_t>(bytesPerWorker, 1);
+    return (int)std::clamp<size_t>(fit, 1, (size_t)workers());
+  }
+
+  static constexpr size_t privateBufferBytes = (size_t)256 << 20;
+
+  template <class F> void run(int tasks, F &&fn) {
+    if (tasks <= 0)
+      return;
+
+    std::unique_lock<std::mutex> busy(runMutex, std::try_to_lock);
+    if (tasks == 1 || threads.empty() || insideWorker() || !busy.owns_lock()) {
+      for (int i = 0; i < tasks; ++i)
+        fn(i);
+      return;
+    }
+
+    std::function<void(int)> task = [&fn](int i) { fn(i); };
+    {
+      std::lock_guard<std::mutex> lk(m);
+      job = &task;
+      taskCount.store(tasks);
+      pending.store(tasks);
+      nextTask.store(0);
+      ++generation;
+    }
+    wake.notify_all();
+
+    work();
+
+    std::unique_lock<std::mutex> lk(m);
+    finished.wait(lk, [&] { return pending.load() == 0 && active == 0; });
+    job = nullptr;
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lk(m);
+      stop = true;
+    }
+    wake.notify_all();
+    for (auto &t : threads)
+      t.join();
+  }
+
+private:
+  ThreadPool() {
+    int n = (int)std::thread::hardware_concurrency();
+    for (int i = 1; i < n; ++i)
+      threads.emplace_back([this] { loop(); });
+  }
+
+  static bool &insideWorker() {
+    static thread_local bool inside = false;
+    return inside;
+  }
+
+  void loop() {
+    insideWorker() = true;
+    unsigned long seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lk(m);
+        wake.wait(lk, [&] { return stop || generation != seen; });
+        if (stop)
+          return;
+        seen = generation;
+        if (!job)
+          continue;
+        ++active;
+      }
+      work();
+      std::lock_guard<std::mutex> lk(m);
+      if (--active == 0)
+        finished.notify_all();
+    }
+  }
+
+  void work() {
+    for (;;) {
+      int i = nextTask.fetch_add(1);
+      if (i >= taskCount.load())
+        break;
+      (*job)(i);
+      if (pending.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lk(m);
+        finished.notify_all();
+      }
+    }
+  }
+
+  std::vector<std::thread> threads;
+  std::mutex runMutex;
+  std::mutex m;
+  std::condition_variable wake, finished;
+  const std::function<void(int)> *job = nullptr;
+  std::atomic<int> taskCount{0}, nextTask{0}, pending{0};
+  unsigned long generation = 0;
+  int active = 0;
+  bool stop = false;
+};
+
+// Splits [begin, end) into chunks of at least `grain` items and calls
+// fn(lo, hi) for each chunk across the pool.
+template <class F>
+void parallelFor(size_t begin, size_t end, size_t grain, F &&fn) {
+  if (end <= begin)
+    return;
+
+  size_t n = end - begin;
+  size_t maxTasks = (size_t)ThreadPool::instance().workers() * 4;
+  grain = std::max<size_t>(grain, 1);
+  size_t tasks = std::min(maxTasks, (n + grain - 1) / grain);
+  tasks = std::max<size_t>(tasks, 1);
+  size_t chunk = (n + tasks - 1) / tasks;
+
+  ThreadPool::instance().run((int)tasks, [&](int t) {
+    size_t lo = begin + (size_t)t * chunk;
+    size_t hi = std::min(end, lo + chunk);
+    if (lo < hi)
+      fn(lo, hi);
+  });
+}
@@ -1,75 +1,183 @@
-#include "fractal.h"
+#include "budget.h"
+#include "line_raster.h"
+#include "subdivision.h"
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
 #include <vector>
 
-class Pythagoras : public FractalFB {
+class Pythagoras : public LineFractal {
 public:
-  Pythagoras(SDL_Renderer *r) : FractalFB(r) {}
+  Pythagoras(SDL_Renderer *r) : LineFractal(r) {}
 
   void reset() override {
-    clear();
-    current.clear();
-    next.clear();
+    clearCanvas();
 
-    current.push_back({(float)width / 2.0f, (float)height - 10.0f,
-                       (float)height / 4.0f, -M_PI / 2.0f, maxDepth});
+    nodes.reset({width / 2.0f, height - 10.0f, 0.0f, -1.0f});
+    len = height / 4.0f;
+    depth = maxDepth;
+    level = 0;
 
-    done = false;
+    claimedDirs.assign((size_t)width * height, 0);
+    claimedLevel.assign((size_t)width * height, 0);
+
+    stats = {};
+    stats.frontier = stats.peakFrontier = nodes.size();
+    levelItems = levelChildren = 0;
   }
 
+  // A level is drawn and expanded by the subdivision engine, resumable
+  // mid-level, so a wide frontier is spread over several frames.
   bool update(float dt, uint32_t maxMs) override {
-    if (done || current.empty())
+    if (nodes.done())
       return false;
 
-    uint32_t start = SDL_GetTicks();
-    SDL_SetRenderTarget(renderer, texture);
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    FrameBudget budget(maxMs);
+    float reach = len * shrink / (1.0f - shrink);
+    bool dedup = reach < overlapRadius;
+    float w = (float)width, h = (float)height;
+    uint32_t white = Palette::rgba(255, 255, 255);
+
+    nodes.step(
+        dt, budget,
+        [&](const Node &p, Node *out) { return expand(p, reach, w, h, out); },
+        [&](const Node *ns, size_t n) {
+          for (size_t i = 0; i < n; ++i)
+            drawLine(ns[i].x, ns[i].y, ns[i].x + len * ns[i].dx,
+                     ns[i].y + len * ns[i].dy, white);
+          rasterizeLines();
+          levelItems += n;
+          counters.iterations += n;
+        },
+        [&](const Node &c) {
+          levelChildren++;
+          if (dedup && !claim(c.x, c.y, c.dx, c.dy)) {
+            stats.culledOverlap++;
+            return false;
+          }
+          return true;
+        },
+        [&] {
+          finishLevel();
+          reach = len * shrink / (1.0f - shrink);
+          dedup = reach < overlapRadius;
+          if (depth > 0 && len >= minLen)
+            return true;
+          stats.culledSubpixel += nodes.size();
+          return false;
+        });
+
+    flushLines();
+
+    stats.frontier = nodes.done() ? 0 : nodes.size();
+    return !nodes.done();
+  }
 
-    levelAccumulator += dt * 10.0f;
+  FractalMetrics metrics() const override {
+    FractalMetrics m = LineFractal::metrics();
+    m.queued = nodes.queued();
+    return m;
+  }
 
-    while (levelAccumulator >= 1.0f && !current.empty()) {
+  const char *getName() const override { return "Pythagoras Tree"; }
 
-      if (SDL_GetTicks() - start >= maxMs)
-        break;
+  std::string getStatus() const override {
+    char buf[128];
+    snprintf(buf, sizeof(buf),
+             "Level %d | Frontier: %zu (peak %zu) | Culled off/sub/dup: "
+             "%zu/%zu/%zu",
+             level, stats.frontier, stats.peakFrontier, stats.culledOffscreen,
+             stats.culledSubpixel, stats.culledOverlap);
+    return buf;
+  }
 
-      next.clear();
-      for (const Node &n : current) {
-        if (n.depth <= 0 || n.len < 1.4f)
-          continue;
+  size_t memoryBytes() const override {
+    return LineFractal::memoryBytes() + nodes.memoryBytes() +
+           claimedDirs.capacity() * sizeof(uint64_t) +
+           claimedLevel.capacity() * sizeof(uint16_t);
+  }
 
-        float x2 = n.x + n.len * std::cos(n.angle);
-        float y2 = n.y + n.len * std::sin(n.angle);
-        SDL_RenderDrawLine(renderer, (int)n.x, (int)n.y, (int)x2, (int)y2);
+  struct Stats {
+    size_t frontier, peakFrontier;
+    size_t expanded;
+    size_t culledOffscreen, culledSubpixel, culledOverlap;
+  };
 
-        next.push_back({x2, y2, n.len * 0.7f, n.angle - 0.4f, n.depth - 1});
-        next.push_back({x2, y2, n.len * 0.7f, n.angle + 0.4f, n.depth - 1});
-      }
+  const Stats &getStats() const { return stats; }
 
-      current.swap(next);
-      levelAccumulator -= 1.0f;
-    }
+private:
+  // Every node of a level shares the same length and depth, so only the
+  // start point and unit direction are stored per node.
+  struct Node {
+    float x, y, dx, dy;
+  };
+
+  // Branch directions come from rotating the parent direction by the fixed
+  // branch angle, which needs no trigonometry per node. Children whose
+  // whole subtree lies off screen are dropped.
+  int expand(const Node &p, float reach, float w, float h, Node *out) const {
+    float ex = p.x + len * p.dx;
+    float ey = p.y + len * p.dy;
+    if (ex + reach < 0.0f || ex - reach > w || ey + reach < 0.0f ||
+        ey - reach > h)
+      return 0;
+
+    out[0] = {ex, ey, p.dx * rotCos + p.dy * rotSin,
+              p.dy * rotCos - p.dx * rotSin};
+    out[1] = {ex, ey, p.dx * rotCos - p.dy * rotSin,
+              p.dy * rotCos + p.dx * rotSin};
+    return 2;
+  }
 
-    SDL_SetRenderTarget(renderer, nullptr);
+  void finishLevel() {
+    stats.expanded += levelItems;
+    stats.culledOffscreen += 2 * levelItems - levelChildren;
+    levelItems = levelChildren = 0;
 
-    if (current.empty())
-      done = true;
-    return !done;
+    len *= shrink;
+    depth--;
+    level = nodes.level();
+    stats.peakFrontier = std::max(stats.peakFrontier, nodes.size());
   }
 
-  const char *getName() const override { return "Pythagoras Tree"; }
+  // Once a whole subtree fits in a few pixels, two subtrees starting in the
+  // same pixel with roughly the same heading draw the same pixels. Only the
+  // first one is kept.
+  bool claim(float px, float py, float ux, float uy) {
+    int ix = (int)px, iy = (int)py;
+    if (ix < 0 || iy < 0 || ix >= width || iy >= height)
+      return true;
+
+    int bx = std::min(7, (int)((ux * 0.5f + 0.5f) * 8.0f));
+    int by = std::min(7, (int)((uy * 0.5f + 0.5f) * 8.0f));
+    uint64_t bit = uint64_t(1) << (bx * 8 + by);
+
+    size_t idx = (size_t)iy * width + ix;
+    if (claimedLevel[idx] != level) {
+      claimedLevel[idx] = (uint16_t)level;
+      claimedDirs[idx] = 0;
+    }
+    if (claimedDirs[idx] & bit)
+      return false;
+    claimedDirs[idx] |= bit;
+    return true;
+  }
 
-private:
-  struct Node {
-    float x, y;
-    float len;
-    float angle;
-    int depth;
-  };
+  Subdivision<Node, 2> nodes{SubdivisionPace::LEVELS, 10.0f,
+                             &counters.allocations};
+  std::vector<uint64_t> claimedDirs;
+  std::vector<uint16_t> claimedLevel;
 
-  std::vector<Node> current;
-  std::vector<Node> next;
+  float len = 0.0f;
+  int depth = 0;
+  int level = 0;
+  Stats stats{};
+  size_t levelItems = 0, levelChildren = 0;
 
-  bool done = false;
   static constexpr int maxDepth = 60;
-  float levelAccumulator = 0.0f;
-};
+  static constexpr float minLen = 1.4f;
+  static constexpr float shrink = 0.7f;
+  static constexpr float overlapRadius = 6.0f;
+  const float rotCos = std::cos(0.4f);
+  const float rotSin = std::sin(0.4f);
+};
\ No newline at end of file
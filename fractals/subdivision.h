@@ -0,0 +1,163 @@
+#pragma once
+#include "budget.h"
+#include "parallel.h"
+#include "work_queue.h"
+#include <algorithm>
+#include <climits>
+#include <type_traits>
+
+enum class SubdivisionPace { ITEMS, LEVELS };
+
+// Breadth-first subdivision shared by the geometric fractals. The frontier
+// is a pair of level buffers. Processing an item splits it into at most
+// Fanout children for the next level and draws it; the items of a level
+// are processed in order, a chunk at a time: the splits of a chunk run in
+// parallel, then the chunk is drawn and its children are queued on the
+// calling thread.
+//
+// Pacing is either in items per second, so the picture grows one shape at
+// a time, or in levels per second, where a level once started is finished
+// as fast as the frame budget allows.
+template <class Shape, int Fanout> class Subdivision {
+public:
+  using Pace = SubdivisionPace;
+
+  // At most `levels` levels are processed; the children of the last one
+  // are not queued.
+  Subdivision(Pace p, float perSecond, uint64_t *allocs, int levels = INT_MAX)
+      : pace(p), rate(perSecond), maxLevels(levels),
+        current(CountingAllocator<Shape>(allocs)),
+        next(CountingAllocator<Shape>(allocs)),
+        children(CountingAllocator<Shape>(allocs)),
+        counts(CountingAllocator<unsigned char>(allocs)) {}
+
+  // Level ping-pong needs each buffer to keep its level parity, so a
+  // rerun fits in the capacity the last run left behind.
+  void reset(const Shape *roots, size_t n) {
+    if (levelIndex % 2)
+      current.swap(next);
+    current.assign(roots, roots + n);
+    next.clear();
+    cursor = 0;
+    levelIndex = 0;
+    credit = 0.0f;
+  }
+
+  void reset(const Shape &root) { reset(&root, 1); }
+
+  // Runs as much of the frontier as dt's pacing credit and the budget
+  // allow, and returns false once nothing is left.
+  //   split(shape, out): writes up to Fanout children, returns how many.
+  //     Runs on pool threads, so it may only read shared state.
+  //   draw(shapes, n): draws n processed items, in frontier order.
+  //   draw(shapes, n, children, counts): the same, with the children split
+  //     produced for them, so drawing never subdivides again. Item i's
+  //     children are counts[i] shapes at children + i * Fanout. With this
+  //     form items of the last level are split too.
+  //   keep(child): filters split's children in order before they are
+  //     queued.
+  //   endLevel(): runs once a level has been processed and the next one
+  //     has become current; returning false ends the subdivision.
+  template <class Split, class Draw, class Keep, class EndLevel>
+  bool step(float dt, const FrameBudget &budget, Split &&split, Draw &&draw,
+            Keep &&keep, EndLevel &&endLevel) {
+    if (done())
+      return false;
+
+    credit += dt * rate;
+    while (credit >= 1.0f && !done() && !budget.expired()) {
+      size_t left = current.size() - cursor;
+      if (pace == Pace::ITEMS)
+        left = std::min(left, (size_t)credit);
+      size_t end = cursor + std::min(left, chunk);
+
+      process(cursor, end, split, draw, keep);
+      if (pace == Pace::ITEMS)
+        credit -= (float)(end - cursor);
+      cursor = end;
+
+      if (cursor == current.size()) {
+        if (pace == Pace::LEVELS)
+          credit -= 1.0f;
+        nextLevel(endLevel);
+      }
+    }
+    return !done();
+  }
+
+  template <class Split, class Draw>
+  bool step(float dt, const FrameBudget &budget, Split &&split, Draw &&draw) {
+    return step(
+        dt, budget, split, draw, [](const Shape &) { return true; },
+        [] { return true; });
+  }
+
+  bool done() const { return current.empty(); }
+  int level() const { return levelIndex; }
+  size_t size() const { return current.size(); }
+
+  size_t queued() const { return current.size() - cursor + next.size(); }
+
+  size_t memoryBytes() const {
+    return (current.capacity() + next.capacity() + children.capacity()) *
+               sizeof(Shape) +
+           counts.capacity();
+  }
+
+private:
+  static constexpr size_t chunk = 4096;
+  static constexpr size_t grain = 512;
+
+  template <class Split, class Draw, class Keep>
+  void process(size_t begin, size_t end, Split &split, Draw &draw,
+               Keep &keep) {
+    constexpr bool withChildren =
+        std::is_invocable_v<Draw &, const Shape *, size_t, const Shape *,
+                            const unsigned char *>;
+    size_t n = end - begin;
+    bool last = levelIndex + 1 >= maxLevels;
+    if (!last || withChildren) {
+      children.resize(n * Fanout);
+      counts.resize(n);
+      parallelFor(begin, end, grain, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; ++i)
+          counts[i - begin] = (unsigned char)split(
+              current[i], &children[(i - begin) * Fanout]);
+      });
+    }
+
+    if constexpr (withChildren)
+      draw(&current[begin], n, children.data(), counts.data());
+    else
+      draw(&current[begin], n);
+
+    if (last)
+      return;
+    for (size_t i = 0; i < n; ++i)
+      for (int j = 0; j < counts[i]; ++j) {
+        const Shape &c = children[i * Fanout + j];
+        if (keep(c))
+          next.push_back(c);
+      }
+  }
+
+  template <class EndLevel> void nextLevel(EndLevel &endLevel) {
+    current.swap(next);
+    next.clear();
+    cursor = 0;
+    levelIndex++;
+    if (!endLevel() || levelIndex >= maxLevels)
+      current.clear();
+  }
+
+  Pace pace;
+  float rate;
+  int maxLevels;
+
+  CountedVector<Shape> current, next;
+  CountedVector<Shape> children;
+  CountedVector<unsigned char> counts;
+  size_t cursor = 0;
+  int levelIndex = 0;
+  float credit = 0.0f;
+};
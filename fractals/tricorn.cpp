@@ -0,0 +1,11 @@
+#include "escape_time.h"
+
+class Tricorn : public EscapeTimeFractal<TricornFormula> {
+public:
+  Tricorn(SDL_Renderer *r)
+      : EscapeTimeFractal(r, 256, 100.0f, Palette::Preset::OCEAN, 6.0f) {
+    centerX = -0.3;
+  }
+
+  const char *getName() const override { return "Tricorn"; }
+};
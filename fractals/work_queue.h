@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Allocator for the work buffers of the subdivision fractals that counts
+// every allocation into the owner's counter. The buffers keep their
+// capacity across levels and resets, so once a fractal has reached its
+// peak queue size the counter stops moving; the metrics show it.
+template <class T> struct CountingAllocator {
+  using value_type = T;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  explicit CountingAllocator(uint64_t *c) : count(c) {}
+  template <class U>
+  CountingAllocator(const CountingAllocator<U> &o) : count(o.count) {}
+
+  T *allocate(size_t n) {
+    ++*count;
+    return std::allocator<T>().allocate(n);
+  }
+  void deallocate(T *p, size_t n) { std::allocator<T>().deallocate(p, n); }
+
+  template <class U> bool operator==(const CountingAllocator<U> &o) const {
+    return count == o.count;
+  }
+  template <class U> bool operator!=(const CountingAllocator<U> &o) const {
+    return count != o.count;
+  }
+
+  uint64_t *count;
+};
+
+template <class T> using CountedVector = std::vector<T, CountingAllocator<T>>;
@@ -1,13 +1,28 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
+#include <algorithm>
 #include <array>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "export.h"
+#include "farm.h"
+#include "metrics.h"
+#include "replay.h"
+#include "fractals/budget.h"
+#include "fractals/cache.h"
 #include "fractals/factory.h"
 
+constexpr Uint32 resize_debounce_ms = 150;
+constexpr int idle_refresh_ms = 1000;
+constexpr Uint32 metrics_interval_ms = 5000;
+constexpr size_t fractal_cache_budget = size_t(512) << 20;
+
 struct App {
   SDL_Window *win = nullptr;
   SDL_Renderer *ren = nullptr;
@@ -16,28 +31,93 @@ struct App {
 
   std::unique_ptr<Fractal> fractal;
   FractalType fractal_type = FractalType::MANDELBROT;
+  FractalCache cache{fractal_cache_budget};
+  BudgetGovernor budget;
+  ResolutionGovernor resolution;
 
   float speed = 1.0f;
   float fps = 0.0f;
+  float cpu = 0.0f;
   int win_w = 1280;
   int win_h = 720;
   int fractal_h = 0;
 
+  // Size the fractal renders at; below the window size for animated
+  // fractals while the resolution governor is scaling them down.
+  int render_w = 0, render_h = 0;
+  float render_scale = 1.0f;
+
   bool running = true;
   bool resize_pending = false;
+  Uint32 resize_deadline = 0;
   bool show_help = true;
   bool paused = false;
+  bool redraw = true;
+  bool idle = false;
+  bool show_metrics = false;
+
+  // Pan requested since the last frame, in fractal pixels.
+  float pan_x = 0.0f, pan_y = 0.0f;
 
-  Uint32 last_ticks = 0;
+  const char *metrics_path = nullptr;
+  Uint32 metrics_deadline = 0;
+
+  // Per-second rates of the visible fractal's counters, for the overlay.
+  FractalType metrics_type = FractalType::COUNT;
+  FractalMetrics metrics_last;
+  double iteration_rate = 0.0, pixel_rate = 0.0, primitive_rate = 0.0;
+
+  Uint64 last_counter = 0;
   int frame_counter = 0;
   Uint32 fps_timer = 0;
+  std::clock_t cpu_clock = 0;
+
+  // Tick clock of the current loop iteration; replays take it from the
+  // session file.
+  Uint32 now = 0;
+  std::vector<SDL_Event> events;
+
+  const char *record_path = nullptr;
+  const char *replay_path = nullptr;
+  SessionRecorder recorder;
+  SessionReader replay;
+  SessionFrame replay_frame;
+  FrameStats frame_stats;
+  int iterations = 0;
 };
 
+float target_scale(const App &app) {
+  return app.fractal && app.fractal->isAnimated() ? app.resolution.scale()
+                                                  : 1.0f;
+}
+
+// render() stretches the texture over the window whatever its size.
+void resize_fractal(App &app) {
+  if (!app.fractal)
+    return;
+  app.render_scale = target_scale(app);
+  app.render_w = std::max(1, (int)(app.win_w * app.render_scale));
+  app.render_h = std::max(1, (int)(app.fractal_h * app.render_scale));
+  app.fractal->setRenderScale(app.render_scale);
+  app.fractal->resize(app.render_w, app.render_h);
+}
+
 TTF_Font *try_load_font(const char *path, int size) {
   return TTF_OpenFont(path, size);
 }
 
 bool setup(App &app) {
+  // Replays run headless and must not pick up renders cached on disk by
+  // an earlier run.
+  if (app.replay_path) {
+    if (!app.replay.open(app.replay_path)) {
+      fprintf(stderr, "replay: cannot read session %s\n", app.replay_path);
+      return false;
+    }
+    setenv("SDL_VIDEODRIVER", "dummy", 1);
+    setenv("FRACTAL_DISK_CACHE", "0", 1);
+  }
+
   if (SDL_Init(SDL_INIT_VIDEO) != 0) {
     return false;
   }
@@ -52,6 +132,11 @@ bool setup(App &app) {
 
   app.win_w = dm.w * 3 / 4;
   app.win_h = dm.h * 3 / 4;
+  if (app.replay_path) {
+    app.win_w = app.replay.info().width;
+    app.win_h = app.replay.info().height;
+    dm.refresh_rate = app.replay.info().refresh_rate;
+  }
   app.fractal_h = app.win_h - 40;
 
   app.win = SDL_CreateWindow("Fractals", SDL_WINDOWPOS_CENTERED,
@@ -64,8 +149,9 @@ bool setup(App &app) {
     return false;
   }
 
-  app.ren = SDL_CreateRenderer(
-      app.win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+  // The dummy driver only has the software renderer.
+  Uint32 flags = SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC;
+  app.ren = SDL_CreateRenderer(app.win, -1, app.replay_path ? 0 : flags);
 
   if (!app.ren) {
     SDL_DestroyWindow(app.win);
@@ -92,12 +178,19 @@ bool setup(App &app) {
   }
 
   app.fractal = createFractal(app.fractal_type, app.ren);
-  if (app.fractal) {
-    app.fractal->resize(app.win_w, app.fractal_h);
-  }
+  resize_fractal(app);
+
+  app.budget.setRefreshRate(dm.refresh_rate);
 
-  app.last_ticks = SDL_GetTicks();
-  app.fps_timer = app.last_ticks;
+  if (app.record_path &&
+      !app.recorder.open(app.record_path,
+                         {app.win_w, app.win_h, dm.refresh_rate}))
+    fprintf(stderr, "record: cannot write %s\n", app.record_path);
+
+  app.last_counter = SDL_GetPerformanceCounter();
+  app.fps_timer = SDL_GetTicks();
+  app.cpu_clock = std::clock();
+  app.metrics_path = std::getenv("FRACTAL_METRICS_FILE");
 
   return true;
 }
@@ -124,15 +217,58 @@ void draw_menu(App &app) {
   SDL_SetRenderDrawColor(app.ren, 80, 85, 100, 255);
   SDL_RenderDrawLine(app.ren, 0, bar.y, app.win_w, bar.y);
 
-  char buf[256];
+  char buf[512];
   const char *name = getFractalName(app.fractal_type);
-  snprintf(buf, sizeof(buf), "%s | Speed: %.1fx | FPS: %.1f | %s", name,
-           app.speed, app.fps, app.paused ? "[PAUSED]" : "");
+  std::string status = app.fractal ? app.fractal->getStatus() : "";
+  snprintf(buf, sizeof(buf),
+           "%s | Speed: %.1fx | FPS: %.1f | CPU: %.0f%% | Budget: %ums | "
+           "Scale: %.0f%% | %s%s%s%s",
+           name, app.speed, app.fps, app.cpu, app.budget.budgetMs(),
+           app.render_scale * 100.0f,
+           status.c_str(), status.empty() ? "" : " | ",
+           app.paused ? "[PAUSED]" : "", app.idle ? "[IDLE]" : "");
 
   SDL_Color col = {220, 230, 255, 255};
   draw_text(app.ren, app.font_small, 10, bar.y + 12, buf, col);
 }
 
+void draw_metrics(App &app) {
+  if (!app.show_metrics || !app.fractal)
+    return;
+
+  FractalMetrics m = app.fractal->metrics();
+  size_t cached = 0;
+  app.cache.forEach(
+      [&](FractalType, const Fractal &f) { cached += f.memoryBytes(); });
+
+  char lines[7][96];
+  snprintf(lines[0], sizeof(lines[0]), "Iterations: %.4g (%.3g/s)",
+           (double)m.iterations, app.iteration_rate);
+  snprintf(lines[1], sizeof(lines[1]), "Pixels resolved: %.4g (%.3g/s)",
+           (double)m.pixelsResolved, app.pixel_rate);
+  snprintf(lines[2], sizeof(lines[2]), "Primitives: %.4g (%.3g/s)",
+           (double)m.primitives, app.primitive_rate);
+  snprintf(lines[3], sizeof(lines[3]), "Queued: %zu", m.queued);
+  snprintf(lines[4], sizeof(lines[4]), "Queue allocations: %llu",
+           (unsigned long long)m.allocations);
+  snprintf(lines[5], sizeof(lines[5]), "Levels dropped: %llu",
+           (unsigned long long)m.levelsDropped);
+  snprintf(lines[6], sizeof(lines[6]), "State: %.1f MiB (cache %zu: %.1f MiB)",
+           app.fractal->memoryBytes() / 1048576.0, app.cache.size(),
+           cached / 1048576.0);
+
+  SDL_Rect box = {10, 10, 330, 20 + 7 * 20};
+  SDL_SetRenderDrawBlendMode(app.ren, SDL_BLENDMODE_BLEND);
+  SDL_SetRenderDrawColor(app.ren, 0, 0, 0, 180);
+  SDL_RenderFillRect(app.ren, &box);
+  SDL_SetRenderDrawBlendMode(app.ren, SDL_BLENDMODE_NONE);
+
+  SDL_Color col = {220, 230, 255, 255};
+  for (int i = 0; i < 7; i++)
+    draw_text(app.ren, app.font_small, box.x + 10, box.y + 10 + i * 20,
+              lines[i], col);
+}
+
 void draw_help(App &app) {
   if (!app.show_help)
     return;
@@ -142,7 +278,7 @@ void draw_help(App &app) {
   SDL_RenderFillRect(app.ren, nullptr);
 
   int w = 400;
-  int h = 280;
+  int h = 478;
   int x = (app.win_w - w) / 2;
   int y = (app.win_h - h) / 2;
 
@@ -157,15 +293,24 @@ void draw_help(App &app) {
 
   draw_text(app.ren, app.font_big, x + 20, y + 20, "Controls", blue);
 
-  std::array<const char *, 9> lines = {"1-9  - Change fractal",
-                                       "+/-  - Change speed",
-                                       "SPACE- Pause animation",
-                                       "F    - Toggle fullscreen",
-                                       "H    - Show/hide help",
-                                       "ESC  - Quit",
-                                       "",
-                                       "Click or press any key",
-                                       "to start..."};
+  std::array<const char *, 18> lines = {"0-9  - Change fractal",
+                                        "TAB  - Next fractal (Shift: previous)",
+                                        "+/-  - Change speed",
+                                        "SPACE- Pause animation",
+                                        "F    - Toggle fullscreen",
+                                        "[ ]  - Tree depth",
+                                        "A    - Anti-aliasing level",
+                                        "C/P/E- Palette, cycle, equalize",
+                                        "B/M  - Anti-Buddhabrot, MH sampling",
+                                        "N    - Next flame preset",
+                                        "R/J  - Realtime Julia, Julia preview",
+                                        "Drag/Arrows - Pan (escape-time)",
+                                        "O    - Metrics overlay",
+                                        "H    - Show/hide help",
+                                        "ESC  - Quit",
+                                        "",
+                                        "Click or press any key",
+                                        "to start..."};
 
   for (size_t i = 0; i < lines.size(); i++) {
     draw_text(app.ren, app.font_small, x + 30, y + 60 + (int)i * 22, lines[i],
@@ -175,26 +320,70 @@ void draw_help(App &app) {
   SDL_SetRenderDrawBlendMode(app.ren, SDL_BLENDMODE_NONE);
 }
 
-void process_events(App &app) {
+void switch_fractal(App &app, FractalType type) {
+  if (app.fractal) {
+    app.fractal->setPointer(false, 0, 0);
+    app.cache.put(app.fractal_type, std::move(app.fractal));
+  }
+
+  app.fractal_type = type;
+  app.fractal = app.cache.take(type);
+  if (!app.fractal)
+    app.fractal = createFractal(type, app.ren);
+  app.resolution.reset();
+  resize_fractal(app);
+}
+
+// Gathers this iteration's events: from SDL, or from the session being
+// replayed, in which case SDL's own are drained and dropped.
+void poll_events(App &app) {
+  app.events.clear();
   SDL_Event ev;
-  while (SDL_PollEvent(&ev)) {
+  while (SDL_PollEvent(&ev))
+    if (!app.replay_path)
+      app.events.push_back(ev);
+  if (app.replay_path)
+    app.events.swap(app.replay_frame.events);
+}
+
+void process_events(App &app) {
+  for (const SDL_Event &ev : app.events) {
     if (ev.type == SDL_QUIT) {
       app.running = false;
       return;
     }
 
+    app.redraw = true;
+
     if (app.show_help &&
         (ev.type == SDL_KEYDOWN || ev.type == SDL_MOUSEBUTTONDOWN)) {
       app.show_help = false;
       continue;
     }
 
+    // The fractal texture is stretched over the whole window, status bar
+    // included, so window coordinates are scaled back to texture pixels.
+    if (ev.type == SDL_MOUSEMOTION && app.fractal) {
+      bool inside = ev.motion.y < app.fractal_h;
+      app.fractal->setPointer(inside, ev.motion.x * app.render_w / app.win_w,
+                              ev.motion.y * app.render_h / app.win_h);
+      if (ev.motion.state & SDL_BUTTON_LMASK) {
+        app.pan_x += ev.motion.xrel * (float)app.render_w / app.win_w;
+        app.pan_y += ev.motion.yrel * (float)app.render_h / app.win_h;
+      }
+    }
+
+    if (ev.type == SDL_WINDOWEVENT &&
+        ev.window.event == SDL_WINDOWEVENT_LEAVE && app.fractal)
+      app.fractal->setPointer(false, 0, 0);
+
     if (ev.type == SDL_WINDOWEVENT &&
         ev.window.event == SDL_WINDOWEVENT_RESIZED) {
       app.win_w = ev.window.data1;
       app.win_h = ev.window.data2;
       app.fractal_h = app.win_h - 40;
       app.resize_pending = true;
+      app.resize_deadline = app.now + resize_debounce_ms;
     }
 
     if (ev.type == SDL_KEYDOWN) {
@@ -209,6 +398,10 @@ void process_events(App &app) {
         app.show_help = !app.show_help;
         break;
 
+      case SDLK_o:
+        app.show_metrics = !app.show_metrics;
+        break;
+
       case SDLK_SPACE:
         app.paused = !app.paused;
         break;
@@ -228,6 +421,30 @@ void process_events(App &app) {
           app.speed = 0.0f;
         break;
 
+      case SDLK_TAB: {
+        int count = (int)FractalType::COUNT;
+        int step = (ev.key.keysym.mod & KMOD_SHIFT) ? count - 1 : 1;
+        switch_fractal(app, (FractalType)(((int)app.fractal_type + step) %
+                                          count));
+        break;
+      }
+
+      case SDLK_LEFT:
+        app.pan_x += app.render_w / 8;
+        break;
+
+      case SDLK_RIGHT:
+        app.pan_x -= app.render_w / 8;
+        break;
+
+      case SDLK_UP:
+        app.pan_y += app.render_h / 8;
+        break;
+
+      case SDLK_DOWN:
+        app.pan_y -= app.render_h / 8;
+        break;
+
       case SDLK_f:
         full = (SDL_GetWindowFlags(app.win) & SDL_WINDOW_FULLSCREEN) != 0;
         SDL_SetWindowFullscreen(app.win,
@@ -235,15 +452,15 @@ void process_events(App &app) {
         break;
 
       default:
-        if (ev.key.keysym.sym >= SDLK_1 && ev.key.keysym.sym <= SDLK_9) {
-          int idx = ev.key.keysym.sym - SDLK_1;
-          if (idx < (int)FractalType::COUNT) {
-            app.fractal_type = (FractalType)idx;
-            app.fractal = createFractal(app.fractal_type, app.ren);
-            if (app.fractal) {
-              app.fractal->resize(app.win_w, app.fractal_h);
-            }
-          }
+        if (app.fractal && app.fractal->handleKey(ev.key.keysym.sym))
+          break;
+        if (ev.key.keysym.sym >= SDLK_0 && ev.key.keysym.sym <= SDLK_9) {
+          // 1-9 pick the first nine fractals and 0 the tenth.
+          int idx = (ev.key.keysym.sym - SDLK_0 + 9) % 10;
+          if (idx == (int)app.fractal_type && app.fractal)
+            app.fractal->reset();
+          else if (idx < (int)FractalType::COUNT)
+            switch_fractal(app, (FractalType)idx);
         }
         break;
       }
@@ -251,6 +468,30 @@ void process_events(App &app) {
   }
 }
 
+// Counters only grow, except when a fractal is evicted from the cache and
+// created again; such a drop reads as zero rather than a negative rate.
+double counter_rate(uint64_t now, uint64_t before, Uint32 elapsed_ms) {
+  return now >= before ? (now - before) * 1000.0 / elapsed_ms : 0.0;
+}
+
+void update_metric_rates(App &app, Uint32 elapsed_ms) {
+  if (!app.fractal)
+    return;
+
+  FractalMetrics m = app.fractal->metrics();
+  if (app.metrics_type == app.fractal_type) {
+    const FractalMetrics &b = app.metrics_last;
+    app.iteration_rate = counter_rate(m.iterations, b.iterations, elapsed_ms);
+    app.pixel_rate =
+        counter_rate(m.pixelsResolved, b.pixelsResolved, elapsed_ms);
+    app.primitive_rate = counter_rate(m.primitives, b.primitives, elapsed_ms);
+  } else {
+    app.iteration_rate = app.pixel_rate = app.primitive_rate = 0.0;
+  }
+  app.metrics_type = app.fractal_type;
+  app.metrics_last = m;
+}
+
 void update_fps(App &app) {
   app.frame_counter++;
 
@@ -258,31 +499,125 @@ void update_fps(App &app) {
   Uint32 elapsed = now - app.fps_timer;
 
   if (elapsed >= 1000) {
+    // Process CPU time over all threads, so it can exceed 100%.
+    std::clock_t cpu = std::clock();
     app.fps = app.frame_counter * 1000.0f / elapsed;
+    app.cpu = float(cpu - app.cpu_clock) * 1000.0f * 100.0f /
+              (CLOCKS_PER_SEC * (float)elapsed);
     app.frame_counter = 0;
     app.fps_timer = now;
+    app.cpu_clock = cpu;
+    update_metric_rates(app, elapsed);
   }
 }
 
+std::vector<MetricsSample> collect_metrics(const App &app) {
+  std::vector<MetricsSample> samples;
+  if (app.fractal)
+    samples.push_back({app.fractal->getName(), true, app.fractal->metrics(),
+                       app.fractal->memoryBytes()});
+  app.cache.forEach([&](FractalType, const Fractal &f) {
+    samples.push_back({f.getName(), false, f.metrics(), f.memoryBytes()});
+  });
+  return samples;
+}
+
+// Blocks until an event arrives, or until the status bar is due for a
+// refresh, leaving the event queued for process_events.
+void wait_for_work(App &app) {
+  SDL_WaitEventTimeout(nullptr, idle_refresh_ms);
+  app.redraw = true;
+  app.last_counter = SDL_GetPerformanceCounter();
+}
+
+// Frames that pre-warm the cache but draw nothing are not paced by the
+// vsync wait in SDL_RenderPresent, so they wait out the rest of the refresh
+// period for input instead of spinning.
+void wait_for_period(App &app, Uint64 frame_start) {
+  double spent = (SDL_GetPerformanceCounter() - frame_start) * 1000.0 /
+                 SDL_GetPerformanceFrequency();
+  double left = app.budget.refreshMs() - spent;
+  if (left >= 1.0)
+    SDL_WaitEventTimeout(nullptr, (int)left);
+}
+
+// Once the fractal has nothing left to compute and nothing else needs the
+// screen, the loop stops presenting frames and sleeps in wait_for_work.
 void run(App &app) {
   while (app.running) {
+    if (app.idle && !app.redraw && !app.replay_path)
+      wait_for_work(app);
+
+    app.budget.beginFrame();
+
+    Uint64 counter = SDL_GetPerformanceCounter();
+    float dt = float(double(counter - app.last_counter) /
+                     SDL_GetPerformanceFrequency());
+    app.last_counter = counter;
     Uint32 now = SDL_GetTicks();
-    float dt = (now - app.last_ticks) / 1000.0f;
-    app.last_ticks = now;
 
     if (dt > 0.1f)
       dt = 0.1f;
 
+    if (app.replay_path) {
+      if (!app.replay.next(app.replay_frame))
+        break;
+      dt = app.replay_frame.dt;
+      now = app.replay_frame.ticks;
+    }
+    app.now = now;
+    app.iterations++;
+
+    poll_events(app);
+    app.recorder.frame(dt, now, app.events);
     process_events(app);
 
-    if (app.resize_pending && app.fractal) {
-      app.fractal->resize(app.win_w, app.fractal_h);
+    if (app.resize_pending && app.fractal &&
+        SDL_TICKS_PASSED(now, app.resize_deadline)) {
+      resize_fractal(app);
       app.resize_pending = false;
+    } else if (!app.resize_pending && target_scale(app) != app.render_scale) {
+      resize_fractal(app);
     }
 
+    // Drag events are coalesced so the buffers shift once per frame.
+    int pan_dx = (int)app.pan_x, pan_dy = (int)app.pan_y;
+    if ((pan_dx || pan_dy) && app.fractal) {
+      app.fractal->pan(pan_dx, pan_dy);
+      app.pan_x -= pan_dx;
+      app.pan_y -= pan_dy;
+    }
+
+    bool busy = false, prewarming = false;
+    app.budget.beginUpdate();
     if (app.fractal && !app.paused) {
-      app.fractal->update(dt * app.speed, 16);
+      FrameBudget frame(app.budget.budgetMs());
+      busy = app.fractal->update(dt * app.speed, app.budget.budgetMs());
+      if (!busy) {
+        double spent = frame.elapsedMs();
+        double left = app.budget.budgetMs() - spent;
+        prewarming = app.cache.prewarm(
+            app.fractal_type, app.ren, app.win_w, app.fractal_h,
+            dt * app.speed, left > 0.0 ? (uint32_t)left : 0);
+      }
     }
+    app.budget.endUpdate();
+
+    if (app.metrics_path && SDL_TICKS_PASSED(now, app.metrics_deadline)) {
+      write_metrics_file(app.metrics_path, collect_metrics(app), app.fps,
+                         app.cpu);
+      app.metrics_deadline = now + metrics_interval_ms;
+    }
+
+    // The frame after the last busy one is still drawn, since that last
+    // update may have changed the texture before reporting completion.
+    app.idle = !busy && !prewarming && !app.resize_pending;
+    if (!busy && !app.redraw && !app.resize_pending) {
+      if (prewarming && !app.replay_path)
+        wait_for_period(app, counter);
+      continue;
+    }
+    app.redraw = busy;
 
     SDL_SetRenderDrawColor(app.ren, 18, 20, 25, 255);
     SDL_RenderClear(app.ren);
@@ -291,11 +626,21 @@ void run(App &app) {
       app.fractal->render();
     }
 
+    draw_metrics(app);
     draw_menu(app);
     draw_help(app);
 
+    app.budget.beforePresent();
     SDL_RenderPresent(app.ren);
     update_fps(app);
+    if (app.replay_path)
+      app.frame_stats.add((SDL_GetPerformanceCounter() - counter) * 1000.0 /
+                          SDL_GetPerformanceFrequency());
+
+    if (app.fractal && !app.fractal->isAnimated())
+      app.resolution.reset();
+    else if (app.fractal && !app.paused)
+      app.resolution.frame(app.budget.frameMs(), app.budget.refreshMs());
   }
 }
 
@@ -304,6 +649,8 @@ void cleanup(App &app) {
     app.fractal.reset();
   }
 
+  app.cache = FractalCache(0);
+
   if (app.font_big) {
     TTF_CloseFont(app.font_big);
   }
@@ -325,13 +672,34 @@ void cleanup(App &app) {
 }
 
 int main(int argc, char **argv) {
+  if (argc > 1 && strcmp(argv[1], "--export") == 0)
+    return run_export(argc, argv);
+  if (argc > 1 && strcmp(argv[1], "--farm") == 0)
+    return run_farm(argc, argv);
+  if (argc > 1 && strcmp(argv[1], "--farm-worker") == 0)
+    return run_farm_worker(argc, argv);
+
   App app;
 
+  for (int i = 1; i < argc; i += 2) {
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (value && strcmp(argv[i], "--record") == 0) {
+      app.record_path = value;
+    } else if (value && strcmp(argv[i], "--replay") == 0) {
+      app.replay_path = value;
+    } else {
+      fprintf(stderr, "usage: Fractal [--record FILE | --replay FILE]\n");
+      return 2;
+    }
+  }
+
   if (!setup(app)) {
     return 1;
   }
 
   run(app);
+  if (app.replay_path)
+    app.frame_stats.print(stdout, app.iterations, app.budget.refreshMs());
   cleanup(app);
 
   return 0;
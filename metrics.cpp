@@ -0,0 +1,73 @@
+#include "metrics.h"
+
+#include <cstdio>
+#include <string>
+
+namespace {
+
+struct Family {
+  const char *name;
+  const char *type;
+  const char *help;
+  double (*value)(const MetricsSample &);
+};
+
+const Family families[] = {
+    {"fractal_iterations_total", "counter",
+     "Orbit steps, subdivisions or expanded nodes computed.",
+     [](const MetricsSample &s) { return (double)s.metrics.iterations; }},
+    {"fractal_pixels_resolved_total", "counter",
+     "Pixels given their final value.",
+     [](const MetricsSample &s) { return (double)s.metrics.pixelsResolved; }},
+    {"fractal_primitives_total", "counter",
+     "Lines, points and rectangles drawn.",
+     [](const MetricsSample &s) { return (double)s.metrics.primitives; }},
+    {"fractal_queued_items", "gauge",
+     "Work items waiting: pending areas, frontier or unresolved pixels.",
+     [](const MetricsSample &s) { return (double)s.metrics.queued; }},
+    {"fractal_allocations_total", "counter",
+     "Heap allocations made by work-queue buffers.",
+     [](const MetricsSample &s) { return (double)s.metrics.allocations; }},
+    {"fractal_levels_dropped_total", "counter",
+     "Levels left undrawn because the frame budget ran out.",
+     [](const MetricsSample &s) {
+       return (double)s.metrics.levelsDropped;
+     }},
+    {"fractal_state_bytes", "gauge",
+     "Approximate bytes held for per-pixel and per-item state.",
+     [](const MetricsSample &s) { return (double)s.bytes; }},
+};
+
+} // namespace
+
+bool write_metrics_file(const char *path,
+                        const std::vector<MetricsSample> &samples, float fps,
+                        float cpu) {
+  std::string tmp = std::string(path) + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "w");
+  if (!f)
+    return false;
+
+  for (const Family &fam : families) {
+    fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", fam.name, fam.help, fam.name,
+            fam.type);
+    for (const MetricsSample &s : samples)
+      fprintf(f, "%s{fractal=\"%s\",state=\"%s\"} %.0f\n", fam.name, s.name,
+              s.active ? "active" : "cached", fam.value(s));
+  }
+
+  fprintf(f,
+          "# HELP fractal_fps Frames presented per second.\n"
+          "# TYPE fractal_fps gauge\nfractal_fps %.1f\n"
+          "# HELP fractal_cpu_percent Process CPU time per wall second.\n"
+          "# TYPE fractal_cpu_percent gauge\nfractal_cpu_percent %.1f\n",
+          fps, cpu);
+
+  bool ok = !ferror(f);
+  ok = fclose(f) == 0 && ok;
+  if (!ok || std::rename(tmp.c_str(), path) != 0) {
+    std::remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "fractals/fractal.h"
+
+// One fractal's metrics as exported: the visible fractal and every fractal
+// held by the cache each contribute one sample.
+struct MetricsSample {
+  const char *name;
+  bool active;
+  FractalMetrics metrics;
+  size_t bytes;
+};
+
+// Writes the samples and the process-wide figures in the Prometheus text
+// format, for the node exporter's textfile collector. The file is written
+// next to path and renamed over it, so a scrape never sees half a file.
+bool write_metrics_file(const char *path,
+                        const std::vector<MetricsSample> &samples, float fps,
+                        float cpu);
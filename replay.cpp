@@ -0,0 +1,194 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace {
+
+constexpr char session_magic[4] = {'F', 'R', 'R', 'S'};
+constexpr uint32_t session_version = 1;
+
+struct EventRecord {
+  uint32_t type;
+  uint32_t a;
+  int32_t b, c, d, e;
+};
+
+EventRecord encode(const SDL_Event &ev) {
+  EventRecord r = {ev.type, 0, 0, 0, 0, 0};
+  switch (ev.type) {
+  case SDL_KEYDOWN:
+  case SDL_KEYUP:
+    r.a = ev.key.keysym.mod;
+    r.b = ev.key.keysym.sym;
+    break;
+  case SDL_MOUSEMOTION:
+    r.a = ev.motion.state;
+    r.b = ev.motion.x;
+    r.c = ev.motion.y;
+    r.d = ev.motion.xrel;
+    r.e = ev.motion.yrel;
+    break;
+  case SDL_MOUSEBUTTONDOWN:
+  case SDL_MOUSEBUTTONUP:
+    r.a = ev.button.button;
+    r.b = ev.button.x;
+    r.c = ev.button.y;
+    break;
+  case SDL_WINDOWEVENT:
+    r.a = ev.window.event;
+    r.b = ev.window.data1;
+    r.c = ev.window.data2;
+    break;
+  }
+  return r;
+}
+
+SDL_Event decode(const EventRecord &r) {
+  SDL_Event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.type = r.type;
+  switch (r.type) {
+  case SDL_KEYDOWN:
+  case SDL_KEYUP:
+    ev.key.keysym.mod = (Uint16)r.a;
+    ev.key.keysym.sym = r.b;
+    break;
+  case SDL_MOUSEMOTION:
+    ev.motion.state = r.a;
+    ev.motion.x = r.b;
+    ev.motion.y = r.c;
+    ev.motion.xrel = r.d;
+    ev.motion.yrel = r.e;
+    break;
+  case SDL_MOUSEBUTTONDOWN:
+  case SDL_MOUSEBUTTONUP:
+    ev.button.button = (Uint8)r.a;
+    ev.button.x = r.b;
+    ev.button.y = r.c;
+    break;
+  case SDL_WINDOWEVENT:
+    ev.window.event = (Uint8)r.a;
+    ev.window.data1 = r.b;
+    ev.window.data2 = r.c;
+    break;
+  }
+  return ev;
+}
+
+template <class T> bool put(FILE *f, const T &v) {
+  return fwrite(&v, sizeof(v), 1, f) == 1;
+}
+
+template <class T> bool get(FILE *f, T &v) {
+  return fread(&v, sizeof(v), 1, f) == 1;
+}
+
+} // namespace
+
+SessionRecorder::~SessionRecorder() {
+  if (file)
+    fclose(file);
+}
+
+bool SessionRecorder::open(const char *path, const SessionInfo &info) {
+  file = fopen(path, "wb");
+  if (!file)
+    return false;
+
+  fwrite(session_magic, 1, sizeof(session_magic), file);
+  put(file, session_version);
+  put(file, (int32_t)info.width);
+  put(file, (int32_t)info.height);
+  put(file, (int32_t)info.refresh_rate);
+  return !ferror(file);
+}
+
+void SessionRecorder::frame(float dt, Uint32 ticks,
+                            const std::vector<SDL_Event> &events) {
+  if (!file)
+    return;
+
+  uint16_t n = (uint16_t)std::min<size_t>(events.size(), UINT16_MAX);
+  put(file, dt);
+  put(file, (uint32_t)ticks);
+  put(file, n);
+  for (uint16_t i = 0; i < n; ++i) {
+    EventRecord r = encode(events[i]);
+    put(file, r.type);
+    put(file, r.a);
+    put(file, r.b);
+    put(file, r.c);
+    put(file, r.d);
+    put(file, r.e);
+  }
+}
+
+SessionReader::~SessionReader() {
+  if (file)
+    fclose(file);
+}
+
+bool SessionReader::open(const char *path) {
+  file = fopen(path, "rb");
+  if (!file)
+    return false;
+
+  char magic[4];
+  uint32_t version;
+  int32_t w, h, hz;
+  if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+      memcmp(magic, session_magic, sizeof(magic)) != 0 ||
+      !get(file, version) || version != session_version || !get(file, w) ||
+      !get(file, h) || !get(file, hz) || w <= 0 || h <= 0)
+    return false;
+
+  header.width = w;
+  header.height = h;
+  header.refresh_rate = hz;
+  return true;
+}
+
+bool SessionReader::next(SessionFrame &frame) {
+  uint32_t ticks;
+  uint16_t n;
+  if (!file || !get(file, frame.dt) || !get(file, ticks) || !get(file, n))
+    return false;
+
+  frame.ticks = ticks;
+  frame.events.clear();
+  for (uint16_t i = 0; i < n; ++i) {
+    EventRecord r;
+    if (!get(file, r.type) || !get(file, r.a) || !get(file, r.b) ||
+        !get(file, r.c) || !get(file, r.d) || !get(file, r.e))
+      return false;
+    frame.events.push_back(decode(r));
+  }
+  return true;
+}
+
+void FrameStats::print(FILE *out, int iterations, double budget_ms) const {
+  std::vector<double> sorted = times;
+  std::sort(sorted.begin(), sorted.end());
+  auto pct = [&](double p) {
+    if (sorted.empty())
+      return 0.0;
+    size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+  };
+  double total = std::accumulate(sorted.begin(), sorted.end(), 0.0);
+  size_t over = sorted.end() - std::upper_bound(sorted.begin(), sorted.end(),
+                                                budget_ms);
+
+  fprintf(out, "iterations %d\n", iterations);
+  fprintf(out, "frames %zu\n", sorted.size());
+  fprintf(out, "total_ms %.1f\n", total);
+  fprintf(out, "mean_ms %.3f\n", sorted.empty() ? 0.0 : total / sorted.size());
+  fprintf(out, "p50_ms %.3f\n", pct(0.50));
+  fprintf(out, "p95_ms %.3f\n", pct(0.95));
+  fprintf(out, "p99_ms %.3f\n", pct(0.99));
+  fprintf(out, "max_ms %.3f\n", sorted.empty() ? 0.0 : sorted.back());
+  fprintf(out, "over_budget %zu\n", over);
+  fprintf(out, "budget_ms %.2f\n", budget_ms);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Session recording for reproducible performance runs. `Fractal --record
+// FILE` logs every main-loop iteration: the dt handed to the fractal, the
+// loop's tick clock and the SDL events it processed. `Fractal --replay
+// FILE` runs the loop again headless under the dummy video driver, fed
+// from the file instead of the clock and the event queue, and prints
+// frame-time statistics.
+//
+// The file is a header followed by one record per iteration, all in host
+// byte order:
+//   header: "FRRS", version, window width, height, refresh rate (u32/i32)
+//   frame:  dt (f32), ticks (u32), event count (u16), then per event
+//           type (u32), one unsigned and four signed fields (u32, 4 x i32)
+// Events keep only the fields the app reads.
+
+struct SessionInfo {
+  int width = 0, height = 0;
+  int refresh_rate = 0;
+};
+
+struct SessionFrame {
+  float dt = 0.0f;
+  Uint32 ticks = 0;
+  std::vector<SDL_Event> events;
+};
+
+class SessionRecorder {
+public:
+  ~SessionRecorder();
+  bool open(const char *path, const SessionInfo &info);
+  void frame(float dt, Uint32 ticks, const std::vector<SDL_Event> &events);
+
+private:
+  FILE *file = nullptr;
+};
+
+class SessionReader {
+public:
+  ~SessionReader();
+  bool open(const char *path);
+  // Reads the next iteration into frame; false at the end of the file.
+  bool next(SessionFrame &frame);
+  const SessionInfo &info() const { return header; }
+
+private:
+  FILE *file = nullptr;
+  SessionInfo header;
+};
+
+// Times of the frames presented during a replay.
+class FrameStats {
+public:
+  void add(double ms) { times.push_back(ms); }
+  // Writes count, mean, percentiles, max and the number of frames over
+  // budget_ms as `key value` lines.
+  void print(FILE *out, int iterations, double budget_ms) const;
+
+private:
+  std::vector<double> times;
+};